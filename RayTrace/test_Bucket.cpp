@@ -1,6 +1,8 @@
 #include "pch.h"
 
 #include "World.h"
+#include "Bvh.h"
+#include "BvhReport.h"
 
 using namespace ray;
 
@@ -39,3 +41,257 @@ TEST(Bucket, Simple) {
 	const auto& shapes = w.shapes();
 	EXPECT_EQ(shapes.size(), 2);
 }
+
+// Planes and open cylinders don't stop bucketing of the rest.
+TEST(Bucket, Unbounded) {
+
+	std::vector<std::unique_ptr<Shape>> vec;
+	for (int i = 0; i < 10; i++) {
+		auto s = std::make_unique<Sphere>();
+		s->transform = Matrix4::translate((i % 2 == 0 ? -1 : 1) * 10, 0, 0);
+		vec.push_back(std::move(s));
+	}
+	vec.push_back(std::make_unique<Plane>());
+	vec.push_back(std::make_unique<Cylinder>());
+	auto capped = std::make_unique<Cylinder>();
+	capped->minimum = 0;
+	capped->maximum = 1;
+	capped->transform = Matrix4::translate(10, 0, 0);
+	vec.push_back(std::move(capped));
+
+	World w(PointLight(Point3(-10, 10, -10), Color::white()), std::move(vec));
+	EXPECT_EQ(w.shapes().size(), 2);
+	EXPECT_EQ(w.unbounded().size(), 2);
+	for (const auto& s : w.shapes()) {
+		EXPECT_TRUE(s->bounds().is_finite());
+	}
+
+	// unbounded shapes are still hit.
+	IntersectionList xs;
+	w.intersect(Ray(Point3(0, 5, 0), Vec3(0, -1, 0)), xs);
+	EXPECT_EQ(xs.size(), 1);
+}
+
+// Each axis gets every 3rd bit, x highest.
+TEST(Bucket, MortonCode) {
+	EXPECT_EQ(morton_code(0, 0, 0), 0);
+	EXPECT_EQ(morton_code(1, 1, 1), (1u << 30) - 1);
+	EXPECT_EQ(morton_code(0.5, 0, 0), 1u << 29);
+	EXPECT_EQ(morton_code(0, 0.5, 0), 1u << 28);
+	EXPECT_EQ(morton_code(0, 0, 0.5), 1u << 27);
+}
+
+// Sorted by code, equal codes keep their order.
+TEST(Bucket, RadixSort) {
+	std::vector<MortonPrim> prims;
+	for (uint32_t i = 0; i < 10000; i++) {
+		prims.push_back({ (i * 2654435761u) % 1000, i });
+	}
+	radix_sort(prims);
+
+	ASSERT_EQ(prims.size(), 10000);
+	for (size_t i = 1; i < prims.size(); i++) {
+		ASSERT_LE(prims[i - 1].code, prims[i].code);
+		if (prims[i - 1].code == prims[i].code) {
+			ASSERT_LT(prims[i - 1].index, prims[i].index);
+		}
+	}
+}
+
+// Simple split: no node spans both halves, planes are kept out of the tree.
+TEST(Bucket, Lbvh) {
+	std::vector<std::unique_ptr<Shape>> vec;
+	for (int i = 0; i < 10; i++) {
+		auto s = std::make_unique<Sphere>();
+		s->transform = Matrix4::translate((i % 2 == 0 ? -1 : 1) * 10, 0, 0);
+		vec.push_back(std::move(s));
+	}
+	vec.push_back(std::make_unique<Plane>());
+
+	World w(PointLight(Point3(-10, 10, -10), Color::white()), std::move(vec), RenderSettings::preview());
+	const auto& shapes = w.shapes();
+	ASSERT_EQ(shapes.size(), 4);
+	ASSERT_EQ(w.unbounded().size(), 1);
+	EXPECT_NE(dynamic_cast<Plane*>(w.unbounded()[0].get()), nullptr);
+	for (size_t i = 0; i < 4; i++) {
+		auto g = dynamic_cast<NoopGroup*>(shapes[i].get());
+		ASSERT_NE(g, nullptr);
+		EXPECT_EQ(g->bounds().max.x - g->bounds().min.x, 2);
+	}
+}
+
+// Tree shape differs, hits must not.
+TEST(Bucket, LbvhMatchesBucket) {
+	auto make_shapes = [] {
+		std::vector<std::unique_ptr<Shape>> vec;
+		for (int x = 0; x < 10; x++) {
+			for (int y = 0; y < 10; y++) {
+				vec.push_back(std::make_unique<Sphere>(Matrix4::translate(x * 1.5, y * 1.5, (x * y) % 3) * Matrix4::scale(0.7, 0.7, 0.7)));
+			}
+		}
+		return vec;
+	};
+
+	World bucket(PointLight(Point3(-10, 10, -10), Color::white()), make_shapes());
+	World lbvh(PointLight(Point3(-10, 10, -10), Color::white()), make_shapes(), RenderSettings::preview());
+
+	for (int x = 0; x < 20; x++) {
+		for (int y = 0; y < 20; y++) {
+			Ray r(Point3(x * 0.8, y * 0.8, -10), Vec3(0.01 * x, 0.01 * y, 1).norm());
+			IntersectionList a, b;
+			bucket.intersect(r, a);
+			lbvh.intersect(r, b);
+			ASSERT_EQ(a.size(), b.size());
+			for (size_t i = 0; i < a.size(); i++) {
+				EXPECT_EQ(a.at(i).t, b.at(i).t);
+			}
+		}
+	}
+}
+
+// Box faces add up, empty bounds have no area.
+TEST(Bucket, SurfaceArea) {
+	EXPECT_EQ(Bounds(Point3(0, 0, 0), Point3(1, 2, 3)).surface_area(), 22);
+	EXPECT_EQ(Bounds().surface_area(), 0);
+}
+
+// A tight cluster and a lone far shape: SAH cuts off the lone shape at the top, rather than halving the list.
+TEST(Bucket, Sah) {
+	std::vector<std::unique_ptr<Shape>> vec;
+	for (int i = 0; i < 9; i++) {
+		vec.push_back(std::make_unique<Sphere>(Matrix4::translate(i * 0.1, 0, 0)));
+	}
+	vec.push_back(std::make_unique<Sphere>(Matrix4::translate(100, 0, 0)));
+
+	RenderSettings settings;
+	settings.build = BuildMode::Sah;
+	World w(PointLight(Point3(-10, 10, -10), Color::white()), std::move(vec), settings);
+	const auto& shapes = w.shapes();
+	ASSERT_EQ(shapes.size(), 4);
+	int lone = 0;
+	for (const auto& s : shapes) {
+		if (s->transform == Matrix4::translate(100, 0, 0)) {
+			lone++;
+		}
+	}
+	EXPECT_EQ(lone, 1);
+}
+
+// Tree shape differs, hits must not.
+TEST(Bucket, SahMatchesBucket) {
+	auto make_shapes = [] {
+		std::vector<std::unique_ptr<Shape>> vec;
+		for (int x = 0; x < 10; x++) {
+			for (int y = 0; y < 10; y++) {
+				vec.push_back(std::make_unique<Sphere>(Matrix4::translate(x * 1.5, y * 1.5, (x * y) % 3) * Matrix4::scale(0.7, 0.7, 0.7)));
+			}
+		}
+		vec.push_back(std::make_unique<Plane>(Matrix4::translate(0, -1, 0)));
+		return vec;
+	};
+
+	RenderSettings settings;
+	settings.build = BuildMode::Sah;
+	World bucket(PointLight(Point3(-10, 10, -10), Color::white()), make_shapes());
+	World sah(PointLight(Point3(-10, 10, -10), Color::white()), make_shapes(), settings);
+
+	for (int x = 0; x < 20; x++) {
+		for (int y = 0; y < 20; y++) {
+			Ray r(Point3(x * 0.8, y * 0.8, -10), Vec3(0.01 * x, 0.01 * y, 1).norm());
+			IntersectionList a, b;
+			bucket.intersect(r, a);
+			sah.intersect(r, b);
+			ASSERT_EQ(a.size(), b.size());
+			for (size_t i = 0; i < a.size(); i++) {
+				EXPECT_EQ(a.at(i).t, b.at(i).t);
+			}
+		}
+	}
+}
+
+// Two clusters of 5 spheres, 20 apart: two groups of 2x2x2 boxes inside a 22x2x2 box.
+TEST(Bucket, Report) {
+	std::vector<std::unique_ptr<Shape>> vec;
+	for (int i = 0; i < 10; i++) {
+		auto s = std::make_unique<Sphere>();
+		s->transform = Matrix4::translate((i % 2 == 0 ? -1 : 1) * 10, 0, 0);
+		vec.push_back(std::move(s));
+	}
+	World w(PointLight(Point3(-10, 10, -10), Color::white()), std::move(vec));
+
+	BvhReport r(w.shapes());
+	EXPECT_EQ(r.nodes, 2);
+	EXPECT_EQ(r.primitives, 10);
+	EXPECT_EQ(r.max_depth, 1);
+	EXPECT_EQ(r.depth_histogram, std::vector<size_t>({ 0, 10 }));
+	EXPECT_EQ(r.leaf_sizes, std::vector<size_t>({ 0, 0, 0, 0, 0, 2 }));
+	EXPECT_EQ(r.top_level, 0);
+	EXPECT_EQ(r.huge, 0);
+	// spheres in a cluster share the same box.
+	EXPECT_DOUBLE_EQ(r.sibling_overlap, 10);
+	double root = 2 * (22 * 2 + 2 * 2 + 2 * 22);
+	EXPECT_DOUBLE_EQ(r.expected_node_visits, 2 * 24 / root);
+	EXPECT_DOUBLE_EQ(r.expected_primitive_tests, 10 * 24 / root);
+	EXPECT_DOUBLE_EQ(r.sah_cost, 12 * 24 / root);
+}
+
+// Shapes that can't be bucketed stay at the top level, and every ray tests them.
+TEST(Bucket, ReportTopLevel) {
+	std::vector<std::unique_ptr<Shape>> vec;
+	for (int i = 0; i < 10; i++) {
+		vec.push_back(std::make_unique<Sphere>());
+	}
+	vec.push_back(std::make_unique<Plane>());
+
+	BvhReport r(NoopGroup::build(std::move(vec), BuildMode::Bucket));
+	EXPECT_EQ(r.nodes, 0);
+	EXPECT_EQ(r.top_level, 10);
+	EXPECT_EQ(r.huge, 10);
+	EXPECT_EQ(r.unbounded, 1);
+	EXPECT_EQ(r.depth_histogram, std::vector<size_t>({ 11 }));
+	EXPECT_DOUBLE_EQ(r.expected_primitive_tests, 11);
+	EXPECT_DOUBLE_EQ(r.sibling_overlap, 0);
+}
+
+// A world's report includes the unbounded shapes it keeps out of the tree.
+TEST(Bucket, ReportWorld) {
+	std::vector<std::unique_ptr<Shape>> vec;
+	for (int i = 0; i < 10; i++) {
+		auto s = std::make_unique<Sphere>();
+		s->transform = Matrix4::translate((i % 2 == 0 ? -1 : 1) * 10, 0, 0);
+		vec.push_back(std::move(s));
+	}
+	vec.push_back(std::make_unique<Plane>());
+	World w(PointLight(Point3(-10, 10, -10), Color::white()), std::move(vec));
+
+	BvhReport tree(w.shapes());
+	EXPECT_EQ(tree.unbounded, 0);
+
+	BvhReport r(w);
+	EXPECT_EQ(r.unbounded, 1);
+	EXPECT_EQ(r.primitives, 11);
+	EXPECT_EQ(r.depth_histogram, std::vector<size_t>({ 1, 10 }));
+	EXPECT_DOUBLE_EQ(r.expected_primitive_tests, tree.expected_primitive_tests + 1);
+	EXPECT_DOUBLE_EQ(r.sah_cost, tree.sah_cost + 1);
+}
+
+// Disjoint children don't overlap, and transformed groups are measured at the top level.
+TEST(Bucket, ReportTransformed) {
+	auto g = std::make_unique<Group>();
+	g->transform = Matrix4::scale(2, 2, 2);
+	auto a = std::make_unique<Sphere>();
+	a->transform = Matrix4::translate(-2, 0, 0);
+	auto b = std::make_unique<Sphere>();
+	b->transform = Matrix4::translate(2, 0, 0);
+	g->add(std::move(a));
+	g->add(std::move(b));
+	std::vector<std::unique_ptr<Shape>> vec;
+	vec.push_back(std::move(g));
+
+	BvhReport r(vec);
+	EXPECT_EQ(r.nodes, 1);
+	EXPECT_DOUBLE_EQ(r.sibling_overlap, 0);
+	EXPECT_DOUBLE_EQ(r.expected_node_visits, 1);
+	// each sphere is a 4x4x4 box in a 12x4x4 one.
+	EXPECT_DOUBLE_EQ(r.expected_primitive_tests, 2 * 96.0 / 224);
+}
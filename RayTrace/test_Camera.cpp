@@ -97,3 +97,79 @@ TEST(Camera, Render) {
 	auto& pixels = canvas.pixels();
 	EXPECT_EQ(pixels[5][5], Color(0.38066f, 0.47583f, 0.2855f));
 }
+
+// The heatmap ramp runs from black for no cost to red for the most.
+TEST(Camera, HeatColor) {
+	EXPECT_EQ(Camera::heat_color(0), Color(0, 0, 0));
+	EXPECT_EQ(Camera::heat_color(0.5), Color(0, 1, 0));
+	EXPECT_EQ(Camera::heat_color(1), Color(1, 0, 0));
+	EXPECT_EQ(Camera::heat_color(2), Color(1, 0, 0));
+	EXPECT_EQ(Camera::heat_color(0.125), Color(0, 0, 0.5));
+}
+
+// Pixels that see the default world's spheres cost more than the edges, which miss them and cast no shadow rays.
+TEST(Camera, Heatmap) {
+	World w;
+	Camera c(11, 11, pi / 2);
+	c.transform = Matrix4::view(Point3(0, 0, -5), Point3(0, 0, 0), Vec3(0, 1, 0));
+	c.verbose = false;
+	if (!stats_enabled) {
+		EXPECT_THROW(c.render_heatmap(w, Heat::Tests), std::runtime_error);
+		return;
+	}
+	std::vector<std::vector<double>> cost(11, std::vector<double>(11, 0.0));
+	c.cost_column(&w, 5, Heat::Tests, cost);
+	EXPECT_GT(cost[5][5], cost[5][0]);
+
+	Canvas canvas = c.render_heatmap(w, Heat::Tests);
+	auto& pixels = canvas.pixels();
+	EXPECT_NE(pixels[5][5], pixels[5][0]);
+	EXPECT_EQ(canvas.width(), 11);
+}
+
+// Time heatmaps work in every build: finite ramp colors, the most expensive pixels at the top of the ramp.
+TEST(Camera, HeatmapTime) {
+	World w;
+	Camera c(11, 7, pi / 2);
+	c.transform = Matrix4::view(Point3(0, 0, -5), Point3(0, 0, 0), Vec3(0, 1, 0));
+	c.verbose = false;
+	Canvas canvas = c.render_heatmap(w, Heat::Time);
+	ASSERT_EQ(canvas.width(), 11);
+	ASSERT_EQ(canvas.height(), 7);
+
+	int hottest = 0;
+	for (const auto& column : canvas.pixels()) {
+		for (const Color& p : column) {
+			for (double channel : { p.r, p.g, p.b }) {
+				EXPECT_TRUE(std::isfinite(channel));
+				EXPECT_GE(channel, 0);
+				EXPECT_LE(channel, 1);
+			}
+			hottest += p == Camera::heat_color(1) ? 1 : 0;
+		}
+	}
+	EXPECT_GE(hottest, 1);
+}
+
+TEST(Camera, WorkerTimes) {
+	World w;
+	Camera c(31, 11, pi / 2);
+	c.transform = Matrix4::view(Point3(0, 0, -5), Point3(0, 0, 0), Vec3(0, 1, 0));
+	c.verbose = false;
+	c.threads = 3;
+	c.render(w);
+	ASSERT_EQ(c.worker_times.size(), 3);
+	int columns = 0;
+	for (const auto& t : c.worker_times) {
+		columns += t.columns;
+		EXPECT_GE(t.busy, 0);
+		EXPECT_GE(t.idle, 0);
+	}
+	EXPECT_EQ(columns, 31);
+
+	c.threads = 1;
+	c.render(w);
+	ASSERT_EQ(c.worker_times.size(), 1);
+	EXPECT_EQ(c.worker_times[0].columns, 31);
+	EXPECT_GT(c.worker_times[0].busy, 0);
+}
@@ -139,3 +139,69 @@ TEST(Canvas, LineSplit) {
 //  Given c ← canvas(5, 3)
 //  When ppm ← canvas_to_ppm(c)
 //  Then ppm ends with a newline character
+
+//Scenario: Reading a file with the wrong magic number
+//  Given ppm ← a file containing:
+//    """
+//    P32
+//    1 1
+//    255
+//    0 0 0
+//    """
+//  Then canvas_from_ppm(ppm) should fail
+TEST(Canvas, ReadPpmMagic) {
+	std::istringstream in("P32\n1 1\n255\n0 0 0\n");
+	EXPECT_THROW(Canvas::read_ppm(in), std::runtime_error);
+}
+
+//Scenario: Reading PPM pixel data, with comments and a triple spanning lines
+//  Given ppm ← a file containing:
+//    """
+//    P3
+//    # this is a comment
+//    2 1
+//    255
+//    51 153
+//
+//    204 255 127 0
+//    """
+//  When canvas ← canvas_from_ppm(ppm)
+//  Then pixel_at(canvas, 0, 0) = color(0.2, 0.6, 0.8)
+//    And pixel_at(canvas, 1, 0) = color(1, 127/255, 0)
+TEST(Canvas, ReadPpm) {
+	std::istringstream in("P3\n# this is a comment\n2 1\n255\n51 153\n\n204 255 127 0\n");
+	Canvas c = Canvas::read_ppm(in);
+	EXPECT_EQ(c.width(), 2);
+	EXPECT_EQ(c.height(), 1);
+	EXPECT_EQ(c.pixels()[0][0], Color(0.2, 0.6, 0.8));
+	EXPECT_EQ(c.pixels()[1][0], Color(1, 127 / 255.0, 0));
+}
+
+//Scenario: PPM parsing respects the scale setting
+//  Given ppm ← a file containing:
+//    """
+//    P3
+//    2 2
+//    100
+//    100 100 100  50 50 50
+//    75 50 25  0 0 0
+//    """
+//  When canvas ← canvas_from_ppm(ppm)
+//  Then pixel_at(canvas, 0, 1) = color(0.75, 0.5, 0.25)
+TEST(Canvas, ReadPpmScale) {
+	std::istringstream in("P3\n2 2\n100\n100 100 100  50 50 50\n75 50 25  0 0 0\n");
+	Canvas c = Canvas::read_ppm(in);
+	EXPECT_EQ(c.pixels()[0][1], Color(0.75, 0.5, 0.25));
+}
+
+// What write_ppm writes reads back, to 8 bits.
+TEST(Canvas, PpmRoundTrip) {
+	Canvas c(7, 4);
+	c.pixels()[3][2] = Color(0.2, 0.4, 1);
+	c.pixels()[6][3] = Color(1.5, -0.5, 0.5);
+	std::stringstream ppm;
+	c.write_ppm(ppm);
+	Canvas back = Canvas::read_ppm(ppm);
+	EXPECT_EQ(back.pixels()[3][2], Color(0.2, 0.4, 1));
+	EXPECT_EQ(back.pixels()[6][3], Color(1, 0, 128 / 255.0));
+}
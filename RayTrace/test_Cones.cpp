@@ -99,6 +99,23 @@ TEST(Cone, Caps) {
 	}
 }
 
+// A cap is as wide as the cone where it is: radius |y|, so 0.5 at y = 0.5. Points between 0.5 and sqrt(0.5) from
+// the axis are outside it, and outside the cone's bounds.
+TEST(Cone, CapRadius) {
+	Cone c;
+	c.minimum = -0.5;
+	c.maximum = 0.5;
+	c.closed = true;
+
+	IntersectionList xs;
+	c.local_intersect(Ray(Point3(0.6, 2, 0), Vec3(0, -1, 0)), xs);
+	EXPECT_EQ(xs.size(), 0);
+
+	IntersectionList inside;
+	c.local_intersect(Ray(Point3(0.45, 2, 0), Vec3(0, -1, 0)), inside);
+	EXPECT_EQ(inside.size(), 4);
+}
+
 //Scenario Outline: Computing the normal vector on a cone
 //  Given shape ← cone()
 //  When n ← local_normal_at(shape, <point>)
@@ -0,0 +1,532 @@
+#include "pch.h"
+#include "World.h"
+#include "SphereSet.h"
+#include "PlyLoader.h"
+#include "Wavefront.h"
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <set>
+#include <sstream>
+
+using namespace ray;
+
+// Differential tests: random rays against the accelerated path (World::intersect, its packet version and shadow
+// queries) and against a brute force reference that tests every primitive with its own textbook intersection,
+// with no bounds, hierarchy, float filters or library kernels.
+// Closest hits and shadow transmittance must agree. Set RAY_DIFF_RAYS=1000000 for a long run after changes to
+// traversal, bounds culling or the builders.
+
+namespace {
+	// Rays per scene and build mode.
+	size_t ray_count(size_t fallback) {
+		const char* env = std::getenv("RAY_DIFF_RAYS");
+		return env != nullptr ? std::strtoull(env, nullptr, 10) : fallback;
+	}
+
+	// Mismatches reported in full per scene, the rest are only counted.
+	constexpr int max_reported = 10;
+
+	// A primitive of a built scene, and the groups and instance the accelerated path passes on the way down to it.
+	struct Leaf {
+		const Shape* shape;
+		std::vector<const Shape*> above;
+		const Instance* instance;
+	};
+
+	void flatten(const Shape* s, std::vector<const Shape*>& above, const Instance* instance, std::vector<Leaf>& out) {
+		if (const Group* g = dynamic_cast<const Group*>(s)) {
+			above.push_back(s);
+			for (const auto& c : g->shapes()) {
+				flatten(c.get(), above, instance, out);
+			}
+			above.pop_back();
+		}
+		else if (const Instance* i = dynamic_cast<const Instance*>(s)) {
+			above.push_back(s);
+			flatten(i->mesh.get(), above, i, out);
+			above.pop_back();
+		}
+		else {
+			out.push_back({ s, above, instance });
+		}
+	}
+
+	// Textbook intersections of the unit primitives, written out here rather than calling the library's kernels, so
+	// a bug in those shows up as a mismatch instead of on both sides. Same cutoffs as the library.
+	namespace reference {
+		void quadratic(double a, double b, double c, std::vector<double>& ts) {
+			double discriminant = b * b - 4 * a * c;
+			if (discriminant < 0) {
+				return;
+			}
+			ts.push_back((-b - std::sqrt(discriminant)) / (2 * a));
+			ts.push_back((-b + std::sqrt(discriminant)) / (2 * a));
+		}
+
+		void sphere(const Point3& o, const Vec3& d, std::vector<double>& ts) {
+			quadratic(d.dot(d), 2 * (o.x * d.x + o.y * d.y + o.z * d.z), o.x * o.x + o.y * o.y + o.z * o.z - 1, ts);
+		}
+
+		void plane(const Point3& o, const Vec3& d, std::vector<double>& ts) {
+			if (std::abs(d.y) >= RAY_EPSILON) {
+				ts.push_back(-o.y / d.y);
+			}
+		}
+
+		void cube(const Point3& o, const Vec3& d, std::vector<double>& ts) {
+			double tmin = -std::numeric_limits<double>::infinity();
+			double tmax = std::numeric_limits<double>::infinity();
+			for (auto [oa, da] : { std::pair(o.x, d.x), std::pair(o.y, d.y), std::pair(o.z, d.z) }) {
+				// a ray along the faces of a slab gets +-max, as Ray's inverse direction does.
+				double inv = da != 0 ? 1 / da : std::numeric_limits<double>::max();
+				double t0 = (-1 - oa) * inv;
+				double t1 = (1 - oa) * inv;
+				tmin = std::max(tmin, std::min(t0, t1));
+				tmax = std::min(tmax, std::max(t0, t1));
+			}
+			if (tmin < tmax) {
+				ts.push_back(tmin);
+				ts.push_back(tmax);
+			}
+		}
+
+		// Sides of a cylinder (cone false) or double cone between minimum and maximum, then the caps of radius
+		// cap(y) when closed.
+		void quadric(const Point3& o, const Vec3& d, bool cone, double minimum, double maximum, bool closed, std::vector<double>& ts) {
+			double k = cone ? 1 : 0;
+			double a = d.x * d.x - k * d.y * d.y + d.z * d.z;
+			double b = 2 * (o.x * d.x - k * o.y * d.y + o.z * d.z);
+			double c = o.x * o.x - k * o.y * o.y + o.z * o.z - (cone ? 0 : 1);
+			std::vector<double> sides;
+			if (std::abs(a) >= RAY_EPSILON) {
+				quadratic(a, b, c, sides);
+			}
+			else if (cone && std::abs(b) >= RAY_EPSILON) {
+				sides.push_back(-c / (2 * b));
+			}
+			for (double t : sides) {
+				double y = o.y + t * d.y;
+				if (minimum < y && y < maximum) {
+					ts.push_back(t);
+				}
+			}
+			if (!closed) {
+				return;
+			}
+			for (double y : { minimum, maximum }) {
+				double t = (y - o.y) / d.y;
+				double x = o.x + t * d.x;
+				double z = o.z + t * d.z;
+				double radius = cone ? std::abs(y) : 1;
+				if (x * x + z * z <= radius * radius) {
+					ts.push_back(t);
+				}
+			}
+		}
+
+		// Moller-Trumbore, recording u and v as the library does.
+		void triangle(const Triangle& tri, const Point3& o, const Vec3& d, IntersectionList& list) {
+			Vec3 p = d.cross(tri.e2);
+			double det = tri.e1.dot(p);
+			if (std::abs(det) < RAY_EPSILON) {
+				return;
+			}
+			Vec3 s = o - tri.p1;
+			double u = s.dot(p) / det;
+			Vec3 q = s.cross(tri.e1);
+			double v = d.dot(q) / det;
+			if (u < 0 || u > 1 || v < 0 || u + v > 1) {
+				return;
+			}
+			list.append(Intersection(tri.e2.dot(q) / det, &tri, u, v));
+		}
+	}
+
+	// Intersects every primitive of a world one by one.
+	class BruteForce {
+	public:
+		explicit BruteForce(const World& w) {
+			std::vector<const Shape*> above;
+			for (const auto& s : w.unbounded()) {
+				flatten(s.get(), above, nullptr, leaves);
+			}
+			for (const auto& s : w.shapes()) {
+				flatten(s.get(), above, nullptr, leaves);
+			}
+			for (const auto& leaf : leaves) {
+				Matrix4 m = Matrix4::identity();
+				uint8_t rays = leaf.shape->rays();
+				for (const Shape* a : leaf.above) {
+					m = m * a->transform;
+					rays &= a->rays();
+				}
+				// a SphereSet's own transform is applied with its spheres.
+				if (dynamic_cast<const SphereSet*>(leaf.shape) == nullptr) {
+					m = m * leaf.shape->transform;
+				}
+				to_leaf.push_back({ m, rays });
+			}
+		}
+
+		void intersect(const Ray& r, IntersectionList& list) const {
+			std::vector<double> ts;
+			for (size_t i = 0; i < leaves.size(); i++) {
+				const Leaf& leaf = leaves[i];
+				if ((to_leaf[i].rays & list.kind()) == 0) {
+					continue;
+				}
+				Ray local = to_leaf[i].transform.inverse_multiply(r);
+				const Point3& o = local.origin;
+				const Vec3& d = local.direction();
+				const Shape* s = leaf.shape;
+				list.set_instance(leaf.instance);
+				ts.clear();
+				if (const SphereSet* set = dynamic_cast<const SphereSet*>(s)) {
+					intersect_spheres(*set, local, list);
+				}
+				else if (const Triangle* t = dynamic_cast<const Triangle*>(s)) {
+					reference::triangle(*t, o, d, list);
+				}
+				else if (dynamic_cast<const Sphere*>(s) != nullptr) {
+					reference::sphere(o, d, ts);
+				}
+				else if (dynamic_cast<const Plane*>(s) != nullptr) {
+					reference::plane(o, d, ts);
+				}
+				else if (dynamic_cast<const Cube*>(s) != nullptr) {
+					reference::cube(o, d, ts);
+				}
+				else if (const Cylinder* c = dynamic_cast<const Cylinder*>(s)) {
+					reference::quadric(o, d, false, c->minimum, c->maximum, c->closed, ts);
+				}
+				else if (const Cone* c = dynamic_cast<const Cone*>(s)) {
+					reference::quadric(o, d, true, c->minimum, c->maximum, c->closed, ts);
+				}
+				else {
+					s->local_intersect(local, list);
+				}
+				for (double t : ts) {
+					list.append(Intersection(t, s));
+				}
+				list.set_instance(nullptr);
+			}
+		}
+
+		// World space center of a random primitive, to aim rays at.
+		Point3 target(std::mt19937& rng) const {
+			const Leaf& leaf = leaves[std::uniform_int_distribution<size_t>(0, leaves.size() - 1)(rng)];
+			Bounds b = leaf.shape->bounds();
+			Point3 p = b.is_finite() ? Point3((b.min.x + b.max.x) / 2, (b.min.y + b.max.y) / 2, (b.min.z + b.max.z) / 2) : Point3(0, 0, 0);
+			p = leaf.shape->transform * p;
+			for (auto a = leaf.above.rbegin(); a != leaf.above.rend(); ++a) {
+				p = (*a)->transform * p;
+			}
+			return p;
+		}
+
+		std::vector<Leaf> leaves;
+
+	private:
+		// Per leaf: everything above it and its own transform in one, and the kinds of ray that see it.
+		struct ToLeaf {
+			Matrix4 transform;
+			uint8_t rays;
+		};
+		std::vector<ToLeaf> to_leaf;
+
+		// Each sphere on its own, instead of through the set's tree.
+		static void intersect_spheres(const SphereSet& set, const Ray& r, IntersectionList& list) {
+			Ray local = set.transform.inverse_multiply(r);
+			for (size_t i = 0; i < set.size(); i++) {
+				Vec3 sphere_ray = local.origin - set.center(i);
+				double a = local.direction().dot(local.direction());
+				double b = 2 * local.direction().dot(sphere_ray);
+				double c = sphere_ray.dot(sphere_ray) - set.radius(i) * set.radius(i);
+				double discriminant = b * b - 4 * a * c;
+				if (discriminant < 0) {
+					continue;
+				}
+				double root = sqrt(discriminant);
+				for (double t : { (-b - root) / (2 * a), (-b + root) / (2 * a) }) {
+					Intersection hit(t, &set);
+					hit.index = static_cast<uint32_t>(i);
+					list.append(std::move(hit));
+				}
+			}
+		}
+	};
+
+	std::string describe(const Intersection* hit) {
+		if (hit == nullptr) {
+			return "miss";
+		}
+		std::stringstream s;
+		s << "t " << hit->t << " on " << typeid(*hit->object).name() << " " << hit->object << " #" << hit->index;
+		return s.str();
+	}
+
+	bool same_t(double a, double b) {
+		return std::abs(a - b) <= 1e-9 * std::max(1.0, std::abs(a));
+	}
+
+	// Hits at the same distance agree, whichever of several coincident surfaces they are on.
+	bool agree(const Intersection* fast, const Intersection* slow) {
+		if (fast == nullptr || slow == nullptr) {
+			return fast == slow;
+		}
+		return same_t(fast->t, slow->t);
+	}
+
+	// Fires rays at w from around its bounds, half in random directions and half at random primitives, one at a
+	// time and in packets, collecting every hit and as closest hit queries, then shadow queries from along them.
+	// Returns the number of mismatches.
+	int compare(const std::string& name, const World& w, size_t rays, uint32_t seed) {
+		BruteForce brute(w);
+		Bounds all;
+		for (const auto& s : w.shapes()) {
+			all.add(s->parent_bounds());
+		}
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<double> unit(0, 1);
+		auto around = [&] {
+			Vec3 size = all.max - all.min;
+			return Point3(all.min.x + size.x * (unit(rng) * 1.5 - 0.25), all.min.y + size.y * (unit(rng) * 1.5 - 0.25),
+				all.min.z + size.z * (unit(rng) * 1.5 - 0.25));
+		};
+		PointLight light(Point3(all.max.x, all.max.y * 2 - all.min.y, all.min.z), Color::white());
+
+		int mismatches = 0;
+		auto report = [&](const std::string& what, const Ray& r, const std::string& fast, const std::string& slow) {
+			if (++mismatches <= max_reported) {
+				ADD_FAILURE() << name << " " << what << " " << r << ": accelerated " << fast << ", brute force " << slow;
+			}
+		};
+
+		for (size_t done = 0; done < rays; done += RayPacket::width) {
+			RayPacket packet;
+			for (int i = 0; i < RayPacket::width; i++) {
+				Point3 from = around();
+				Vec3 direction = i % 2 == 0 ? Vec3(unit(rng) - 0.5, unit(rng) - 0.5, unit(rng) - 0.5) : brute.target(rng) - from;
+				if (direction.magnitude() < 1e-6) {
+					direction = Vec3(0, 0, 1);
+				}
+				packet.add(Ray(from, direction.norm()));
+			}
+
+			std::array<IntersectionList, RayPacket::width> lists;
+			w.intersect(packet, lists.data());
+			std::array<IntersectionList, RayPacket::width> nearest;
+			for (auto& list : nearest) {
+				list.keep_closest();
+			}
+			w.intersect(packet, nearest.data());
+			for (int i = 0; i < RayPacket::width; i++) {
+				const Ray& r = packet.rays[i];
+				IntersectionList fast;
+				w.intersect(r, fast);
+				IntersectionList closest;
+				closest.keep_closest();
+				w.intersect(r, closest);
+				IntersectionList slow;
+				brute.intersect(r, slow);
+				const Intersection* slow_hit = slow.hit();
+				if (!agree(fast.hit(), slow_hit)) {
+					report("ray", r, describe(fast.hit()), describe(slow_hit));
+				}
+				if (!agree(lists[i].hit(), slow_hit)) {
+					report("packet ray", r, describe(lists[i].hit()), describe(slow_hit));
+				}
+				if (!agree(closest.hit(), slow_hit)) {
+					report("closest ray", r, describe(closest.hit()), describe(slow_hit));
+				}
+				if (!agree(nearest[i].hit(), slow_hit)) {
+					report("closest packet ray", r, describe(nearest[i].hit()), describe(slow_hit));
+				}
+
+				// shadow from a point along the ray, or just off the surface it hits.
+				Point3 point = slow_hit != nullptr ? r.position(slow_hit->t) + (r.origin - r.position(slow_hit->t)).norm() * (RAY_EPSILON * 4)
+					: r.position(unit(rng) * (all.max - all.min).magnitude());
+				Vec3 v = light.position - point;
+				Ray shadow_ray(point, v.norm());
+				IntersectionList shadow = IntersectionList::shadow(v.magnitude());
+				brute.intersect(shadow_ray, shadow);
+				double fast_light = w.light_transmittance(light, point);
+				bool both_dark = fast_light < IntersectionList::min_transmittance && shadow.done();
+				if (!both_dark && !same_t(fast_light, shadow.transmittance())) {
+					report("shadow", shadow_ray, std::to_string(fast_light), std::to_string(shadow.transmittance()));
+				}
+			}
+		}
+		return mismatches;
+	}
+
+	Matrix4 random_transform(std::mt19937& rng, double spread) {
+		std::uniform_real_distribution<double> unit(0, 1);
+		double s = 0.2 + unit(rng) * 1.3;
+		return Matrix4::translate((unit(rng) - 0.5) * spread, (unit(rng) - 0.5) * spread, (unit(rng) - 0.5) * spread) *
+			Matrix4::rotateY(unit(rng) * 2 * pi) * Matrix4::rotateX(unit(rng) * 2 * pi) *
+			Matrix4::scale(s, s * (0.5 + unit(rng)), s);
+	}
+
+	std::unique_ptr<Shape> random_primitive(std::mt19937& rng) {
+		std::uniform_real_distribution<double> unit(0, 1);
+		std::unique_ptr<Shape> s;
+		switch (std::uniform_int_distribution<int>(0, 4)(rng)) {
+		case 0:
+			s = std::make_unique<Sphere>();
+			break;
+		case 1:
+			s = std::make_unique<Cube>();
+			break;
+		case 2: {
+			auto c = std::make_unique<Cylinder>();
+			c->minimum = -unit(rng);
+			c->maximum = unit(rng);
+			c->closed = unit(rng) < 0.5;
+			s = std::move(c);
+			break;
+		}
+		case 3: {
+			auto c = std::make_unique<Cone>();
+			c->minimum = -1;
+			c->maximum = unit(rng);
+			c->closed = unit(rng) < 0.5;
+			s = std::move(c);
+			break;
+		}
+		default: {
+			auto p = [&] { return Point3(unit(rng) * 2 - 1, unit(rng) * 2 - 1, unit(rng) * 2 - 1); };
+			s = std::make_unique<Triangle>(p(), p(), p());
+			break;
+		}
+		}
+		if (unit(rng) < 0.3) {
+			s->material.transparency = 0.5;
+		}
+		return s;
+	}
+
+	// Every kind of shape: loose primitives, transformed and nested groups, a sphere set, instances of a shared
+	// mesh, duplicates and a plane. Same scene for the same seed.
+	std::vector<std::unique_ptr<Shape>> random_scene(uint32_t seed) {
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<double> unit(0, 1);
+		std::vector<std::unique_ptr<Shape>> vec;
+
+		for (int i = 0; i < 150; i++) {
+			auto s = random_primitive(rng);
+			s->transform = random_transform(rng, 20);
+			vec.push_back(std::move(s));
+		}
+
+		auto outer = std::make_unique<Group>();
+		outer->transform = random_transform(rng, 10);
+		auto inner = std::make_unique<Group>();
+		inner->transform = random_transform(rng, 4);
+		for (int i = 0; i < 12; i++) {
+			auto s = random_primitive(rng);
+			s->transform = random_transform(rng, 6);
+			inner->add(std::move(s));
+			s = random_primitive(rng);
+			s->transform = random_transform(rng, 6);
+			outer->add(std::move(s));
+		}
+		outer->add(std::move(inner));
+		vec.push_back(std::move(outer));
+
+		std::vector<SphereSet::Entry> spheres;
+		for (int i = 0; i < 200; i++) {
+			spheres.push_back({ Point3(unit(rng) * 10, unit(rng) * 10, unit(rng) * 10), 0.05 + unit(rng) * 0.4 });
+		}
+		vec.push_back(std::make_unique<SphereSet>(spheres, Matrix4::translate(-15, -5, -5)));
+
+		auto mesh = std::make_shared<Group>();
+		for (int i = 0; i < 10; i++) {
+			auto t = random_primitive(rng);
+			t->transform = random_transform(rng, 3);
+			mesh->add(std::move(t));
+		}
+		for (int i = 0; i < 3; i++) {
+			vec.push_back(std::make_unique<Instance>(mesh, random_transform(rng, 20)));
+		}
+
+		for (int i = 0; i < 3; i++) {
+			auto s = std::make_unique<Sphere>();
+			s->transform = Matrix4::translate(12, 0, 0);
+			vec.push_back(std::move(s));
+		}
+
+		auto floor = std::make_unique<Plane>();
+		floor->transform = Matrix4::translate(0, -15, 0);
+		vec.push_back(std::move(floor));
+		return vec;
+	}
+
+	// Primitives of shapes, looking through groups and instances.
+	std::set<const Shape*> primitives(const std::vector<std::unique_ptr<Shape>>& shapes) {
+		std::vector<Leaf> leaves;
+		std::vector<const Shape*> above;
+		for (const auto& s : shapes) {
+			flatten(s.get(), above, nullptr, leaves);
+		}
+		std::set<const Shape*> set;
+		for (const auto& l : leaves) {
+			set.insert(l.shape);
+		}
+		return set;
+	}
+
+	const BuildMode build_modes[] = { BuildMode::Bucket, BuildMode::Lbvh, BuildMode::Sah };
+}
+
+// Builders keep every primitive: the built tree holds exactly the shapes handed in.
+TEST(Differential, BuildKeepsPrimitives) {
+	for (BuildMode mode : build_modes) {
+		auto shapes = random_scene(1);
+		std::set<const Shape*> before = primitives(shapes);
+		RenderSettings settings;
+		settings.build = mode;
+		World w(PointLight(Point3(-10, 10, -10), Color::white()), std::move(shapes), settings);
+		std::set<const Shape*> after = primitives(w.shapes());
+		for (const Shape* s : primitives(w.unbounded())) {
+			after.insert(s);
+		}
+		EXPECT_EQ(before, after);
+	}
+}
+
+TEST(Differential, RandomScene) {
+	for (BuildMode mode : build_modes) {
+		for (uint32_t seed = 1; seed <= 3; seed++) {
+			RenderSettings settings;
+			settings.build = mode;
+			World w(PointLight(Point3(-10, 10, -10), Color::white()), random_scene(seed), settings);
+			EXPECT_EQ(compare("random scene " + std::to_string(seed), w, ray_count(2000), seed), 0);
+		}
+	}
+}
+
+// Loaded meshes: the book's OBJ fixture, and a 9286 face PLY scan when the models are checked out.
+TEST(Differential, LoadedScenes) {
+	{
+		std::ifstream file("triangles.obj");
+		ASSERT_TRUE(file.good());
+		Wavefront obj(file);
+		std::vector<std::unique_ptr<Shape>> vec;
+		vec.push_back(obj.get_mega_group());
+		World w(PointLight(Point3(-10, 10, -10), Color::white()), std::move(vec));
+		EXPECT_EQ(compare("triangles.obj", w, ray_count(2000), 7), 0);
+	}
+
+	if (!std::ifstream("../models/spider.ply").good()) {
+		return;
+	}
+	for (BuildMode mode : build_modes) {
+		PlyLoader ply("../models/spider.ply");
+		std::vector<std::unique_ptr<Shape>> vec;
+		vec.push_back(ply.get_mega_group(mode));
+		World w(PointLight(Point3(-10, 10, -10), Color::white()), std::move(vec));
+		EXPECT_EQ(compare("spider.ply", w, ray_count(2000), 11), 0);
+	}
+}
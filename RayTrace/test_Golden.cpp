@@ -0,0 +1,99 @@
+#include "pch.h"
+#include "scenes.h"
+#include <cstdlib>
+#include <fstream>
+
+// Golden image tests: each standard scene rendered small and compared with its reference in golden/.
+// Shading, precision and sampling changes that alter the picture fail here; diff images show where.
+//
+// RAY_GOLDEN_UPDATE=1 rewrites the references from the current renders, after a change that is meant to alter them.
+// On a mismatch <scene>_actual.ppm and <scene>_diff.ppm (red where pixels are off, the reference dimmed elsewhere)
+// are written to RAY_GOLDEN_OUT, or the working directory.
+
+namespace {
+	constexpr int golden_width = 80;
+	constexpr int golden_height = 40;
+
+	// A pixel is off when a channel differs by more than this: twice the rounding of an 8 bit channel.
+	constexpr double pixel_tolerance = 2.0 / 255;
+	// A scene fails when more than this fraction of its pixels are off, or when they are off by this much on average.
+	constexpr double off_fraction_tolerance = 0.005;
+	constexpr double mean_tolerance = 0.5 / 255;
+
+	std::string env(const char* name, const std::string& fallback) {
+		const char* value = std::getenv(name);
+		return value != nullptr ? value : fallback;
+	}
+
+	Canvas render(const Scene& scene) {
+		Camera camera(golden_width, golden_height, pi / 3);
+		camera.verbose = false;
+		// scenes place things with rand(), seed it so every run builds the same scene.
+		srand(1);
+		World world = scene.build(RenderSettings(), "../models/", camera);
+		return camera.render(world);
+	}
+
+	// Channel difference through write_ppm's 8 bit rounding, as a reference read back has it.
+	double difference(const Color& a, const Color& b) {
+		auto channel = [](double c) { return std::clamp(static_cast<int>(c * 255 + 0.5), 0, 255) / 255.0; };
+		return std::max({ std::abs(channel(a.r) - channel(b.r)), std::abs(channel(a.g) - channel(b.g)),
+			std::abs(channel(a.b) - channel(b.b)) });
+	}
+}
+
+TEST(Golden, Scenes) {
+	bool update = env("RAY_GOLDEN_UPDATE", "") == "1";
+	std::string out = env("RAY_GOLDEN_OUT", ".");
+
+	for (const Scene& scene : all_scenes()) {
+		SCOPED_TRACE(scene.name);
+		if ((scene.name == "dragon" || scene.name == "spiders") && !std::ifstream("../models/spider.ply").good()) {
+			continue;
+		}
+		Canvas actual = render(scene);
+		std::string path = "golden/" + scene.name + ".ppm";
+		if (update) {
+			std::ofstream file(path);
+			actual.write_ppm(file);
+			continue;
+		}
+
+		std::ifstream file(path);
+		ASSERT_TRUE(file.good()) << "no reference " << path << ", run with RAY_GOLDEN_UPDATE=1 to make one";
+		Canvas expected = Canvas::read_ppm(file);
+		ASSERT_EQ(expected.width(), actual.width());
+		ASSERT_EQ(expected.height(), actual.height());
+
+		Canvas diff(golden_width, golden_height);
+		size_t off = 0;
+		double total = 0;
+		double worst = 0;
+		for (int x = 0; x < golden_width; x++) {
+			for (int y = 0; y < golden_height; y++) {
+				const Color& e = expected.pixels()[x][y];
+				double d = difference(e, actual.pixels()[x][y]);
+				total += d;
+				worst = std::max(worst, d);
+				if (d > pixel_tolerance) {
+					off++;
+					diff.pixels()[x][y] = Color(0.5 + d / 2, 0, 0);
+				}
+				else {
+					diff.pixels()[x][y] = e * 0.25;
+				}
+			}
+		}
+
+		double pixels = golden_width * golden_height;
+		bool pass = off <= off_fraction_tolerance * pixels && total / pixels <= mean_tolerance;
+		EXPECT_TRUE(pass) << off << " of " << pixels << " pixels off, mean difference " << total / pixels * 255
+			<< "/255, worst " << worst * 255 << "/255. See " << out << "/" << scene.name << "_diff.ppm";
+		if (!pass) {
+			std::ofstream actual_file(out + "/" + scene.name + "_actual.ppm");
+			actual.write_ppm(actual_file);
+			std::ofstream diff_file(out + "/" + scene.name + "_diff.ppm");
+			diff.write_ppm(diff_file);
+		}
+	}
+}
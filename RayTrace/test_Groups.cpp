@@ -84,10 +84,11 @@ TEST(Group, Intersect) {
 	IntersectionList xs;
 	g.local_intersect(r, xs);
 	EXPECT_EQ(xs.size(), 4);
-	EXPECT_EQ(xs.at(0).object, weak_s1);
-	EXPECT_EQ(xs.at(1).object, weak_s1);
-	EXPECT_EQ(xs.at(2).object, weak_s2);
-	EXPECT_EQ(xs.at(3).object, weak_s2);
+	// children are visited near to far, so hits come out in the book's order without sorting.
+	EXPECT_EQ(xs.at(0).object, weak_s2);
+	EXPECT_EQ(xs.at(1).object, weak_s2);
+	EXPECT_EQ(xs.at(2).object, weak_s1);
+	EXPECT_EQ(xs.at(3).object, weak_s1);
 }
 
 //Scenario: Intersecting a transformed group
@@ -112,3 +113,181 @@ TEST(Group, IntersectTransformedGroup) {
 	g.intersect(r, xs);
 	EXPECT_EQ(xs.size(), 2);
 }
+
+// Children of a wide node come out near to far, across more than one SIMD pack.
+TEST(Group, IntersectNearToFar) {
+	Group g;
+	std::vector<Shape*> weak;
+	for (int i : { 5, 1, 4, 0, 3, 2 }) {
+		auto s = std::make_unique<Sphere>(Matrix4::translate(0, 0, i * 3.0));
+		weak.push_back(s.get());
+		g.add(std::move(s));
+	}
+
+	Ray r(Point3(0, 0, -5), Vec3(0, 0, 1));
+	IntersectionList xs;
+	g.local_intersect(r, xs);
+	EXPECT_EQ(xs.size(), 12);
+	for (size_t i = 1; i < xs.size(); i++) {
+		EXPECT_LE(xs.at(i - 1).t, xs.at(i).t);
+	}
+}
+
+// Children whose bounds the ray misses are skipped.
+TEST(Group, IntersectSkipsMissedChildren) {
+	Group g;
+	auto hit = std::make_unique<Sphere>();
+	Shape* weak_hit = hit.get();
+	g.add(std::move(hit));
+	for (int i = 1; i < 6; i++) {
+		g.add(std::make_unique<Sphere>(Matrix4::translate(i * 3.0, 0, 0)));
+	}
+
+	Ray r(Point3(0, 0, -5), Vec3(0, 0, 1));
+	IntersectionList xs;
+	g.local_intersect(r, xs);
+	EXPECT_EQ(xs.size(), 2);
+	EXPECT_EQ(xs.at(0).object, weak_hit);
+}
+
+// A binary tree of NoopGroups collapses into one 4-wide node.
+TEST(Group, Collapse) {
+	auto left = std::make_unique<NoopGroup>();
+	left->add(std::make_unique<Sphere>(Matrix4::translate(-3, 0, 0)));
+	left->add(std::make_unique<Sphere>(Matrix4::translate(-6, 0, 0)));
+
+	auto right = std::make_unique<NoopGroup>();
+	right->add(std::make_unique<Sphere>(Matrix4::translate(3, 0, 0)));
+	right->add(std::make_unique<Sphere>(Matrix4::translate(6, 0, 0)));
+
+	auto root = std::make_unique<NoopGroup>();
+	root->add(std::move(left));
+	root->add(std::move(right));
+
+	std::vector<std::unique_ptr<Shape>> vec;
+	vec.push_back(std::move(root));
+	vec = NoopGroup::collapse(std::move(vec), 4);
+
+	EXPECT_EQ(vec.size(), 4);
+	for (const auto& s : vec) {
+		EXPECT_NE(dynamic_cast<Sphere*>(s.get()), nullptr);
+		EXPECT_EQ(s->parent, nullptr);
+	}
+}
+
+// Groups too big to fit stay, but their own children are collapsed.
+TEST(Group, CollapseNested) {
+	auto inner = std::make_unique<NoopGroup>();
+	inner->add(std::make_unique<Sphere>());
+	inner->add(std::make_unique<Sphere>());
+
+	auto outer = std::make_unique<NoopGroup>();
+	outer->add(std::move(inner));
+	outer->add(std::make_unique<Sphere>());
+
+	std::vector<std::unique_ptr<Shape>> vec;
+	vec.push_back(std::move(outer));
+	for (int i = 0; i < 3; i++) {
+		vec.push_back(std::make_unique<Sphere>());
+	}
+	vec = NoopGroup::collapse(std::move(vec), 4);
+
+	EXPECT_EQ(vec.size(), 4);
+	auto g = dynamic_cast<NoopGroup*>(vec[0].get());
+	ASSERT_NE(g, nullptr);
+	EXPECT_EQ(g->size(), 3);
+	for (const auto& s : g->shapes()) {
+		EXPECT_EQ(s->parent, g);
+	}
+}
+
+// Primitive children are tested from the group's flattened copies, with the same hits as their own intersect.
+TEST(Group, FlattenedChildrenMatch) {
+	std::vector<std::unique_ptr<Shape>> children;
+	children.push_back(std::make_unique<Sphere>(Matrix4::translate(-3, 0, 0) * Matrix4::scale(0.5, 1, 0.5)));
+	children.push_back(std::make_unique<Cube>(Matrix4::translate(-1, 0.5, 0) * Matrix4::rotateY(0.4)));
+	auto cyl = std::make_unique<Cylinder>(Matrix4::translate(1, 0, 0) * Matrix4::scale(0.5, 1, 0.5));
+	cyl->minimum = -1;
+	cyl->maximum = 1;
+	cyl->closed = true;
+	children.push_back(std::move(cyl));
+	auto cone = std::make_unique<Cone>(Matrix4::translate(3, 0, 0) * Matrix4::rotateZ(0.2));
+	cone->minimum = -1;
+	cone->maximum = 0.5;
+	cone->closed = true;
+	children.push_back(std::move(cone));
+	children.push_back(std::make_unique<Triangle>(Point3(0, 2, 1), Point3(-2, -1, 1), Point3(2, -1, 1)));
+	auto tri = std::make_unique<Triangle>(Point3(0, 1, 0), Point3(-1, -1, 0), Point3(1, -1, 0));
+	tri->transform = Matrix4::translate(0, 0, 2) * Matrix4::rotateX(0.3);
+	children.push_back(std::move(tri));
+	children.push_back(std::make_unique<Plane>(Matrix4::translate(0, -2, 0)));
+	auto inner = std::make_unique<Group>(Matrix4::translate(0, 2, 0));
+	inner->add(std::make_unique<Sphere>());
+	children.push_back(std::move(inner));
+
+	std::vector<const Shape*> shapes;
+	Group g(Matrix4::rotateY(0.1));
+	for (auto& c : children) {
+		shapes.push_back(c.get());
+		g.add(std::move(c));
+	}
+
+	for (int x = -20; x <= 20; x++) {
+		for (int y = -12; y <= 12; y++) {
+			Ray r(Point3(x * 0.2, y * 0.2, -5), Vec3(0.01 * x, -0.02, 1).norm());
+			IntersectionList xs;
+			g.intersect(r, xs);
+			xs.sort();
+
+			Ray local = g.transform.inverse_multiply(r);
+			IntersectionList expected;
+			for (auto s : shapes) {
+				s->intersect(local, expected);
+			}
+			expected.sort();
+
+			ASSERT_EQ(xs.size(), expected.size());
+			for (size_t i = 0; i < xs.size(); i++) {
+				EXPECT_EQ(xs.at(i).object, expected.at(i).object);
+				EXPECT_EQ(xs.at(i).t, expected.at(i).t);
+			}
+		}
+	}
+}
+
+// Children hidden from a kind of ray are skipped by it, and a group only sees the kinds its children do.
+TEST(Group, Visibility) {
+	auto s1 = std::make_unique<Sphere>();
+	auto s2 = std::make_unique<Sphere>(Matrix4::translate(0, 0, 5));
+	s2->visible_to_camera = false;
+	auto t = std::make_unique<Triangle>(Point3(-1, -1, 10), Point3(1, -1, 10), Point3(0, 1, 10));
+	t->cast_shadows = false;
+	Group g;
+	g.add(std::move(s1));
+	g.add(std::move(s2));
+	g.add(std::move(t));
+	EXPECT_EQ(g.rays(), AllRays);
+
+	Ray r(Point3(0, 0, -5), Vec3(0, 0, 1));
+	IntersectionList camera(CameraRay);
+	g.intersect(r, camera);
+	EXPECT_EQ(camera.size(), 3);
+	IntersectionList secondary(SecondaryRay);
+	g.intersect(r, secondary);
+	EXPECT_EQ(secondary.size(), 5);
+	IntersectionList shadow(ShadowRay);
+	g.intersect(r, shadow);
+	EXPECT_EQ(shadow.size(), 4);
+
+	// a backdrop group hides everything in it from shadows.
+	auto backdrop = std::make_unique<Group>();
+	auto wall = std::make_unique<Sphere>();
+	wall->cast_shadows = false;
+	backdrop->add(std::move(wall));
+	EXPECT_EQ(backdrop->rays(), CameraRay | SecondaryRay);
+	Group outer;
+	outer.add(std::move(backdrop));
+	IntersectionList none(ShadowRay);
+	outer.intersect(r, none);
+	EXPECT_EQ(none.size(), 0);
+}
@@ -0,0 +1,137 @@
+#include "pch.h"
+
+#include "World.h"
+
+using namespace ray;
+
+// A small mesh: two spheres in a group.
+static std::shared_ptr<Group> make_mesh() {
+	auto mesh = std::make_shared<Group>(Matrix4::scale(2, 2, 2));
+	mesh->add(std::make_unique<Sphere>(Matrix4::translate(-1.5, 0, 0)));
+	mesh->add(std::make_unique<Sphere>(Matrix4::translate(1.5, 0, 0)));
+	return mesh;
+}
+
+// Instances share one mesh, nothing is copied.
+TEST(Instance, SharesMesh) {
+	auto mesh = make_mesh();
+	Instance a(mesh, Matrix4::translate(10, 0, 0));
+	Instance b(mesh, Matrix4::translate(-10, 0, 0));
+	EXPECT_EQ(mesh.use_count(), 3);
+	EXPECT_EQ(a.mesh.get(), b.mesh.get());
+}
+
+// Bounds include the mesh transform.
+TEST(Instance, Bounds) {
+	Instance i(make_mesh(), Matrix4::translate(10, 0, 0));
+	EXPECT_EQ(i.bounds(), Bounds(Point3(-5, -2, -2), Point3(5, 2, 2)));
+}
+
+// Hits land on the mesh shape, tagged with the instance.
+TEST(Instance, Intersect) {
+	auto mesh = make_mesh();
+	Instance i(mesh, Matrix4::translate(0, 0, 10));
+
+	Ray r(Point3(3, 0, -5), Vec3(0, 0, 1));
+	IntersectionList xs;
+	i.intersect(r, xs);
+	xs.sort();
+	ASSERT_EQ(xs.size(), 2);
+	EXPECT_EQ(xs.at(0).t, 13);
+	EXPECT_EQ(xs.at(1).t, 17);
+	EXPECT_EQ(xs.at(0).object, mesh->shapes()[1].get());
+	EXPECT_EQ(xs.instance(xs.at(0)), &i);
+}
+
+// Normals go through the instance and the mesh transforms.
+TEST(Instance, Normal) {
+	auto mesh = make_mesh();
+	Instance i(mesh, Matrix4::translate(0, 0, 10) * Matrix4::rotateY(pi / 2));
+
+	// mesh x axis is the world -z axis, so the +x sphere is nearest.
+	Ray r(Point3(0, 0, -5), Vec3(0, 0, 1));
+	IntersectionList xs;
+	i.intersect(r, xs);
+	xs.sort();
+	ASSERT_EQ(xs.size(), 4);
+	IntersectionInfo info = xs.info(r, xs.hit());
+	EXPECT_EQ(info.point, Point3(0, 0, 5));
+	EXPECT_EQ(info.normal, Vec3(0, 0, -1));
+	EXPECT_EQ(info.instance, &i);
+}
+
+// Overridden material is used for shading, others use the mesh materials.
+TEST(Instance, Material) {
+	auto mesh = make_mesh();
+	Instance plain(mesh);
+	Instance red(mesh);
+	Material m;
+	m.pattern = std::make_unique<Solid>(Color::red());
+	red.update_material(m);
+
+	Intersection hit(1, mesh->shapes()[0].get());
+
+	EXPECT_EQ(&hit.material(&plain), &mesh->shapes()[0]->material);
+	EXPECT_EQ(&hit.material(&red), &red.material);
+}
+
+// Same shade as a deep copy of the mesh in the same place.
+TEST(Instance, WorldMatchesCopy) {
+	auto mesh = make_mesh();
+	Matrix4 place = Matrix4::translate(1, 0.5, 3) * Matrix4::rotateX(0.3);
+
+	std::vector<std::unique_ptr<Shape>> instanced;
+	auto inst = std::make_unique<Instance>(mesh, place);
+	Material m;
+	m.pattern = std::make_unique<Stripe>(Color::red(), Color::white());
+	inst->update_material(m);
+	instanced.push_back(std::move(inst));
+	World wi(PointLight(Point3(-10, 10, -10), Color::white()), std::move(instanced));
+
+	std::vector<std::unique_ptr<Shape>> copied;
+	auto copy = make_mesh();
+	auto outer = std::make_unique<Group>(place);
+	auto inner = std::make_unique<Group>(copy->transform);
+	for (auto& s : copy->extract_shapes()) {
+		inner->add(std::move(s));
+	}
+	outer->add(std::move(inner));
+	outer->update_material(m);
+	copied.push_back(std::move(outer));
+	World wc(PointLight(Point3(-10, 10, -10), Color::white()), std::move(copied));
+
+	for (int x = -10; x <= 10; x++) {
+		Ray r(Point3(x * 0.5, 0.5, -10), Vec3(0, 0, 1));
+		EXPECT_EQ(wi.color_at(r), wc.color_at(r));
+	}
+}
+
+// Two instances of one glass sphere are still two containers when refracting.
+TEST(Instance, RefractiveIndex) {
+	auto glass = std::make_shared<Sphere>();
+	glass->material = Material::glass();
+
+	Instance a(glass, Matrix4::translate(0, 0, -0.25));
+	Instance b(glass, Matrix4::translate(0, 0, 0.25));
+
+	Ray r(Point3(0, 0, -4), Vec3(0, 0, 1));
+	IntersectionList xs;
+	a.intersect(r, xs);
+	b.intersect(r, xs);
+	xs.sort();
+	ASSERT_EQ(xs.size(), 4);
+
+	// entering b while inside a: glass to glass, not glass to air.
+	IntersectionInfo info = xs.info(r, &xs.at(1));
+	EXPECT_EQ(info.n1, 1.52);
+	EXPECT_EQ(info.n2, 1.52);
+
+	// leaving a while inside b.
+	info = xs.info(r, &xs.at(2));
+	EXPECT_EQ(info.n1, 1.52);
+	EXPECT_EQ(info.n2, 1.52);
+
+	info = xs.info(r, &xs.at(3));
+	EXPECT_EQ(info.n1, 1.52);
+	EXPECT_EQ(info.n2, 1);
+}
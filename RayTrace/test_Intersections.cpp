@@ -341,6 +341,127 @@ TEST(Intersect, SchlickSmall) {
 TEST(Intersect, CtorUV) {
 	auto shape = std::make_unique<Triangle>(Point3(0, 1, 0), Point3(-1, 0, 0), Point3(1, 0, 0));
 	Intersection i(3.5, shape.get(), 0.2, 0.4);
-	EXPECT_EQ(i.u, 0.2);
-	EXPECT_EQ(i.v, 0.4);
+	// stored as float.
+	EXPECT_FLOAT_EQ(i.u, 0.2);
+	EXPECT_FLOAT_EQ(i.v, 0.4);
+}
+
+// Hit records stay small, they are copied around a lot. No bigger than the book's object, t, u and v.
+TEST(Intersect, Size) {
+	EXPECT_LE(sizeof(Intersection), 32);
+}
+
+// A list reuses the storage of the last one destroyed on this thread, so big lists only allocate once.
+TEST(Intersect, ListReusesStorage) {
+	auto shape = std::make_unique<Sphere>();
+	const Intersection* first;
+	{
+		IntersectionList xs;
+		for (int i = 0; i < 100; i++) {
+			xs.append(Intersection(i, shape.get()));
+		}
+		first = &xs.at(0);
+	}
+
+	IntersectionList xs;
+	EXPECT_EQ(xs.size(), 0);
+	xs.append(Intersection(1, shape.get()));
+	EXPECT_EQ(&xs.at(0), first);
+}
+
+// Crossing a surface enters it, crossing it again leaves it, from anywhere in the stack.
+TEST(Intersect, MediumStack) {
+	auto a = Sphere::glass();
+	auto b = Sphere::glass();
+	b->material.refractive_index = 2;
+
+	MediumStack media;
+	EXPECT_EQ(media.refractive_index(), 1);
+	media.cross(Intersection(1, a.get()));
+	EXPECT_EQ(media.refractive_index(), 1.52);
+	media.cross(Intersection(2, b.get()));
+	EXPECT_EQ(media.refractive_index(), 2);
+	media.cross(Intersection(3, a.get()));
+	EXPECT_EQ(media.size(), 1);
+	EXPECT_EQ(media.refractive_index(), 2);
+	media.cross(Intersection(4, b.get()));
+	EXPECT_EQ(media.size(), 0);
+	EXPECT_EQ(media.refractive_index(), 1);
+}
+
+// Same indices as working them out from every hit, using only the nearest hit and the media of the ray.
+TEST(Intersect, InfoFromMedia) {
+	auto a = Sphere::glass();
+	a->transform = Matrix4::scale(2, 2, 2);
+	auto b = Sphere::glass();
+	b->transform = Matrix4::translate(0, 0, -0.25);
+	b->material.refractive_index = 2;
+	auto c = Sphere::glass();
+	c->transform = Matrix4::translate(0, 0, 0.25);
+	c->material.refractive_index = 2.5;
+
+	Ray r(Point3(0, 0, -4), Vec3(0, 0, 1));
+	IntersectionList xs;
+	a->intersect(r, xs);
+	b->intersect(r, xs);
+	c->intersect(r, xs);
+	xs.sort();
+
+	MediumStack media;
+	for (size_t i = 0; i < xs.size(); i++) {
+		IntersectionInfo expected = xs.info(r, &xs.at(i));
+		IntersectionInfo info = xs.info(r, &xs.at(i), media);
+		EXPECT_EQ(info.n1, expected.n1);
+		EXPECT_EQ(info.n2, expected.n2);
+		media.cross(xs.at(i));
+	}
+}
+
+// A plane crossed behind the ray has no second hit, so working indices out from hits wrongly puts the ray inside it.
+TEST(Intersect, InfoFromMediaIgnoresPlaneBehind) {
+	auto glass = Sphere::glass();
+	auto floor = std::make_unique<Plane>(Matrix4::translate(0, -0.95, 0));
+
+	// refracted ray inside the sphere, heading up.
+	Ray r(Point3(0, -0.9, 0), Vec3(0, 1, 0));
+	IntersectionList xs;
+	glass->intersect(r, xs);
+	floor->intersect(r, xs);
+	xs.sort();
+
+	MediumStack media;
+	media.cross(Intersection(-1, glass.get()));
+	IntersectionInfo info = xs.info(r, xs.hit(), media);
+	EXPECT_EQ(info.object, glass.get());
+	EXPECT_EQ(info.n1, 1.52);
+	EXPECT_EQ(info.n2, 1);
+
+	IntersectionInfo from_hits = xs.info(r, xs.hit());
+	EXPECT_EQ(from_hits.n1, 1);
+}
+
+// A closest hit query keeps only the nearest hit at t >= 0, ties going to the first found, and is past() what's beyond.
+TEST(Intersect, KeepClosest) {
+	auto a = std::make_unique<Sphere>();
+	auto b = std::make_unique<Sphere>();
+	IntersectionList xs;
+	xs.keep_closest();
+	EXPECT_FALSE(xs.past(1e300));
+
+	xs.append(Intersection(-1, a.get()));
+	EXPECT_EQ(xs.size(), 0);
+	xs.append(Intersection(5, a.get()));
+	xs.append(Intersection(7, b.get()));
+	xs.append(Intersection(3, b.get()));
+	xs.append(Intersection(3, a.get()));
+	ASSERT_EQ(xs.size(), 1);
+	EXPECT_EQ(xs.hit()->t, 3);
+	EXPECT_EQ(xs.hit()->object, b.get());
+	EXPECT_FALSE(xs.past(3));
+	EXPECT_TRUE(xs.past(3.1));
+
+	// shadow queries are past the light.
+	IntersectionList shadow = IntersectionList::shadow(10);
+	EXPECT_FALSE(shadow.past(10));
+	EXPECT_TRUE(shadow.past(11));
 }
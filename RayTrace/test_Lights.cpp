@@ -16,3 +16,14 @@ TEST(Light, Ctor) {
 	EXPECT_EQ(light.position, Point3(0,0,0));
 	EXPECT_EQ(light.intensity, Color(1,1,1));
 }
+
+// Range fades the light out smoothly, the default never does.
+TEST(Light, Falloff) {
+	PointLight light(Point3(0, 0, 0), Color(1, 1, 1));
+	EXPECT_EQ(light.falloff(1e9), 1);
+	PointLight ranged(Point3(0, 0, 0), Color(1, 1, 1), 10);
+	EXPECT_EQ(ranged.falloff(0), 1);
+	EXPECT_DOUBLE_EQ(ranged.falloff(5), (1 - 0.0625) * (1 - 0.0625));
+	EXPECT_EQ(ranged.falloff(10), 0);
+	EXPECT_EQ(ranged.falloff(20), 0);
+}
@@ -57,7 +57,7 @@ TEST(Material, Lighting) {
 	Vec3 normalv(0, 0, -1);
 	PointLight light(Point3(0, 0, -10), Color(1, 1, 1));
 	Sphere sphere;
-	Color result = mat.lighting(light, sphere, position, eyev, normalv, false);
+	Color result = mat.lighting(light, sphere, position, eyev, normalv, 1.0);
 	EXPECT_EQ(result, Color(1.9f, 1.9f, 1.9f));
 }
 
@@ -75,7 +75,7 @@ TEST(Material, Lighting45deg) {
 	Vec3 normalv(0, 0, -1);
 	PointLight light(Point3(0, 0, -10), Color(1, 1, 1));
 	Sphere sphere;
-	Color result = mat.lighting(light, sphere, position, eyev, normalv, false);
+	Color result = mat.lighting(light, sphere, position, eyev, normalv, 1.0);
 	EXPECT_EQ(result, Color(1, 1, 1));
 }
 
@@ -92,7 +92,7 @@ TEST(Material, Lighting45degEyeBack) {
 	Vec3 normalv(0, 0, -1);
 	PointLight light(Point3(0, 10, -10), Color(1, 1, 1));
 	Sphere sphere;
-	Color result = mat.lighting(light, sphere, position, eyev, normalv, false);
+	Color result = mat.lighting(light, sphere, position, eyev, normalv, 1.0);
 	EXPECT_EQ(result, Color(0.7364f, 0.7364f, 0.7364f));
 }
 
@@ -110,7 +110,7 @@ TEST(Material, LightingReflectPath) {
 	Vec3 normalv(0, 0, -1);
 	PointLight light(Point3(0, 10, -10), Color(1, 1, 1));
 	Sphere sphere;
-	Color result = mat.lighting(light, sphere, position, eyev, normalv, false);
+	Color result = mat.lighting(light, sphere, position, eyev, normalv, 1.0);
 	EXPECT_EQ(result, Color(1.6364f, 1.6364f, 1.6364f));
 }
 
@@ -127,7 +127,7 @@ TEST(Material, LightingEyeSurfLight) {
 	Vec3 normalv(0, 0, -1);
 	PointLight light(Point3(0, 0, 10), Color(1, 1, 1)); 
 	Sphere sphere;
-	Color result = mat.lighting(light, sphere, position, eyev, normalv, false);
+	Color result = mat.lighting(light, sphere, position, eyev, normalv, 1.0);
 	EXPECT_EQ(result, Color(0.1f, 0.1f, 0.1f));
 }
 
@@ -144,9 +144,9 @@ TEST(Material, InShadow) {
 	Vec3 eye(0, 0, -1);
 	Vec3 normal(0, 0, -1);
 	PointLight light(Point3(0, 0, -10), Color(1, 1, 1));
-	bool in_shadow = true;
+	double visible = 0.0;
 	Sphere sphere;
-	Color result = mat.lighting(light, sphere, position, eye, normal, in_shadow);
+	Color result = mat.lighting(light, sphere, position, eye, normal, visible);
 	EXPECT_EQ(result, Color(0.1f, 0.1f, 0.1f));
 }
 
@@ -173,9 +173,9 @@ TEST(Material, Pattern) {
 	PointLight light(Point3(0, 0, -10), Color::white());
 	Sphere sphere;
 
-	Color c1 = mat.lighting(light, sphere, Point3(0.9, 0, 0), eye, normal, false);
+	Color c1 = mat.lighting(light, sphere, Point3(0.9, 0, 0), eye, normal, 1.0);
 	EXPECT_EQ(c1, Color::white());
 
-	Color c2 = mat.lighting(light, sphere, Point3(1.1, 0, 0), eye, normal, false);
+	Color c2 = mat.lighting(light, sphere, Point3(1.1, 0, 0), eye, normal, 1.0);
 	EXPECT_EQ(c2, Color::black());
 }
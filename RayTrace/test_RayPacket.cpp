@@ -0,0 +1,158 @@
+#include "pch.h"
+#include <random>
+
+#include "RayPacket.h"
+#include "World.h"
+#include "Camera.h"
+
+using namespace ray;
+
+// Rays fill lanes in order.
+TEST(RayPacket, Add) {
+	RayPacket packet;
+	EXPECT_EQ(packet.size(), 0);
+
+	Ray r1(Point3(0, 0, -5), Vec3(0, 0, 1));
+	Ray r2(Point3(1, 0, -5), Vec3(0, 0, 1));
+	packet.add(r1);
+	packet.add(r2);
+
+	EXPECT_EQ(packet.size(), 2);
+	EXPECT_EQ(packet.active, 0x3);
+	EXPECT_EQ(packet.rays[0], r1);
+	EXPECT_EQ(packet.rays[1], r2);
+}
+
+// Each lane gets the same answer as the scalar slab test.
+TEST(RayPacket, HitMask) {
+	RayPacket packet;
+	packet.add(Ray(Point3(0, 0, -5), Vec3(0, 0, 1)));
+	packet.add(Ray(Point3(5, 0, -5), Vec3(0, 0, 1)));
+	packet.add(Ray(Point3(0.99, 0.99, -5), Vec3(0, 0, 1)));
+	packet.add(Ray(Point3(-5, 0, 0), Vec3(0, 1, 0)));
+
+	FloatBounds b(Bounds(Point3(-1, -1, -1), Point3(1, 1, 1)));
+	EXPECT_EQ(packet.hit_mask(b, packet.active), 0x5);
+
+	// masked out lanes are never reported.
+	EXPECT_EQ(packet.hit_mask(b, 0x4), 0x4);
+}
+
+// A small box seen from far away: float rounding of the origin and of the distances from it dwarfs the box, the
+// padding must still keep every grazing ray the double slab test accepts.
+TEST(RayPacket, HitMaskFarOrigin) {
+	Bounds box(Point3(0.5, 0.25, -0.125), Point3(0.501, 0.2501, -0.1245));
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<double> unit(-1, 1);
+	FloatBounds b(box);
+
+	int accepted = 0;
+	for (double distance : { 1e3, 1e5, 1e7 }) {
+		for (int i = 0; i < 2000; i++) {
+			Point3 origin = Point3(0, 0, 0) + Vec3(unit(rng), unit(rng), unit(rng)).norm() * distance;
+			// aim at a corner, edge or face of the box, just inside or outside it.
+			Point3 target(box.min.x + (box.max.x - box.min.x) * std::round(unit(rng) + 1) / 2 + unit(rng) * 1e-9,
+				box.min.y + (box.max.y - box.min.y) * std::round(unit(rng) + 1) / 2 + unit(rng) * 1e-9,
+				box.min.z + (box.max.z - box.min.z) * (unit(rng) + 1) / 2);
+			Ray r(origin, (target - origin).norm());
+
+			auto [xmin, xmax] = Cube::check_axis(box.min.x, box.max.x, r.origin.x, r.invdirection().x);
+			auto [ymin, ymax] = Cube::check_axis(box.min.y, box.max.y, r.origin.y, r.invdirection().y);
+			auto [zmin, zmax] = Cube::check_axis(box.min.z, box.max.z, r.origin.z, r.invdirection().z);
+			if (std::max({ xmin, ymin, zmin }) > std::min({ xmax, ymax, zmax })) {
+				continue;
+			}
+			accepted++;
+
+			RayPacket packet;
+			packet.add(r);
+			EXPECT_EQ(packet.hit_mask(b, packet.active), 0x1) << "origin " << origin << " target " << target;
+		}
+	}
+	EXPECT_GT(accepted, 1000);
+}
+
+// Packet moved into group space matches per ray transform.
+TEST(RayPacket, InverseMultiply) {
+	RayPacket packet;
+	Ray r(Point3(1, 2, 3), Vec3(0, 1, 0));
+	packet.add(r);
+
+	Matrix4 m = Matrix4::translate(3, 4, 5);
+	RayPacket local = packet.inverse_multiply(m);
+	EXPECT_EQ(local.active, 0x1);
+	EXPECT_EQ(local.rays[0], m.inverse_multiply(r));
+}
+
+// Packet traversal must find the same colors as tracing each ray on its own.
+TEST(RayPacket, WorldMatchesSingleRays) {
+	std::vector<std::unique_ptr<Shape>> vec;
+	for (int x = -2; x <= 2; x++) {
+		for (int y = -2; y <= 2; y++) {
+			auto s = std::make_unique<Sphere>();
+			s->transform = Matrix4::translate(x * 2.5, y * 2.5, 0) * Matrix4::scale(0.8, 0.8, 0.8);
+			s->material.pattern = std::make_unique<Solid>(Color(0.2 * (x + 3), 0.2 * (y + 3), 0.5));
+			vec.push_back(std::move(s));
+		}
+	}
+	auto floor = std::make_unique<Plane>();
+	floor->transform = Matrix4::translate(0, -6, 0);
+	vec.push_back(std::move(floor));
+
+	World w(PointLight(Point3(-10, 10, -10), Color::white()), std::move(vec));
+
+	Camera c(21, 19, pi / 2);
+	c.transform = Matrix4::view(Point3(0, 0, -10), Point3(0, 0, 0), Vec3(0, 1, 0));
+
+	for (int x = 0; x < c.hsize; x++) {
+		for (int y = 0; y < c.vsize; y += RayPacket::width) {
+			RayPacket packet;
+			for (int i = 0; i < RayPacket::width && y + i < c.vsize; i++) {
+				packet.add(c.ray(x, y + i));
+			}
+
+			auto colors = w.color_at(packet);
+			for (int i = 0; i < packet.size(); i++) {
+				EXPECT_EQ(colors[i], w.color_at(packet.rays[i]));
+			}
+		}
+	}
+}
+
+// Primitives and packed triangles tested once for the whole packet give each ray the hits it gets on its own.
+TEST(RayPacket, GroupMatchesSingleRays) {
+	Group g;
+	for (int i = 0; i < 9; i++) {
+		g.add(std::make_unique<Triangle>(Point3(i - 4, 1, i * 0.1), Point3(i - 4.5, -1, 0.5), Point3(i - 3.5, -0.5, -0.25)));
+	}
+	g.add(std::make_unique<Sphere>(Matrix4::translate(0, 2, 1) * Matrix4::scale(0.5, 0.5, 0.5)));
+	auto cyl = std::make_unique<Cylinder>(Matrix4::translate(2, -2, 1) * Matrix4::rotateZ(0.3));
+	cyl->minimum = -1;
+	cyl->maximum = 1;
+	cyl->closed = true;
+	g.add(std::move(cyl));
+	g.add(std::make_unique<Cube>(Matrix4::translate(-2, -2, 2) * Matrix4::scale(0.5, 0.5, 0.5)));
+
+	for (int x = -24; x <= 24; x++) {
+		for (int y = -16; y <= 16; y += RayPacket::width) {
+			RayPacket packet;
+			for (int i = 0; i < RayPacket::width; i++) {
+				packet.add(Ray(Point3(0, 0, -5), Vec3(x * 0.02, (y + i) * 0.02, 1).norm()));
+			}
+
+			std::array<IntersectionList, RayPacket::width> lists;
+			g.intersect_packet(packet, packet.active, lists.data());
+			for (int i = 0; i < RayPacket::width; i++) {
+				IntersectionList single;
+				g.intersect(packet.rays[i], single);
+				single.sort();
+				lists[i].sort();
+				ASSERT_EQ(lists[i].size(), single.size());
+				for (size_t h = 0; h < single.size(); h++) {
+					EXPECT_EQ(lists[i].at(h).object, single.at(h).object);
+					EXPECT_EQ(lists[i].at(h).t, single.at(h).t);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,118 @@
+#include "pch.h"
+
+#include "SphereSet.h"
+#include "World.h"
+
+using namespace ray;
+
+// n spheres on a jittered grid, radius 0.3 to 0.45.
+static std::vector<SphereSet::Entry> make_spheres(int n) {
+	std::vector<SphereSet::Entry> spheres;
+	for (int i = 0; i < n; i++) {
+		double x = (i % 7) + 0.1 * (i % 3);
+		double y = ((i / 7) % 7) - 0.05 * (i % 5);
+		double z = i / 49;
+		spheres.push_back({ Point3(x - 3, y - 3, z), 0.3 + 0.05 * (i % 4) });
+	}
+	return spheres;
+}
+
+// Bounds cover every sphere.
+TEST(SphereSet, Bounds) {
+	SphereSet set({ { Point3(0, 0, 0), 1 }, { Point3(5, 2, -1), 0.5 } });
+	EXPECT_EQ(set.size(), 2);
+	EXPECT_EQ(set.bounds(), Bounds(Point3(-1, -1, -1.5), Point3(5.5, 2.5, 1)));
+}
+
+// Hits, normals and t values match a transformed Sphere.
+TEST(SphereSet, MatchesSphere) {
+	SphereSet set({ { Point3(1, 2, 3), 2 } });
+	Sphere sphere(Matrix4::translate(1, 2, 3) * Matrix4::scale(2, 2, 2));
+
+	Ray r(Point3(1.5, 2.5, -5), Vec3(0, 0, 1));
+	IntersectionList xs;
+	set.intersect(r, xs);
+	IntersectionList expected;
+	sphere.intersect(r, expected);
+
+	ASSERT_EQ(xs.size(), 2);
+	ASSERT_EQ(expected.size(), 2);
+	for (size_t i = 0; i < 2; i++) {
+		EXPECT_TRUE(IsEqual(xs.at(i).t, expected.at(i).t));
+		Point3 p = r.position(xs.at(i).t);
+		EXPECT_EQ(set.normal_at(p, xs.at(i)), sphere.normal_at(p, expected.at(i)));
+	}
+}
+
+// Same hits as testing every sphere on its own, across several blocks and tree levels.
+TEST(SphereSet, MatchesSpheres) {
+	auto spheres = make_spheres(300);
+	SphereSet set(spheres, Matrix4::rotateY(0.3));
+
+	for (int x = -20; x <= 20; x++) {
+		for (int y = -20; y <= 20; y++) {
+			Ray r(Point3(x * 0.2, y * 0.2, -10), Vec3(0.01 * x, -0.01 * y, 1).norm());
+			IntersectionList xs;
+			set.intersect(r, xs);
+			xs.sort();
+
+			IntersectionList expected;
+			for (size_t i = 0; i < set.size(); i++) {
+				Sphere s(set.transform * Matrix4::translate(set.center(i).x, set.center(i).y, set.center(i).z) *
+					Matrix4::scale(set.radius(i), set.radius(i), set.radius(i)));
+				s.intersect(r, expected);
+			}
+			expected.sort();
+
+			ASSERT_EQ(xs.size(), expected.size());
+			for (size_t i = 0; i < xs.size(); i++) {
+				EXPECT_NEAR(xs.at(i).t, expected.at(i).t, 1e-9);
+			}
+		}
+	}
+}
+
+// Spheres of one set are separate containers when refracting.
+TEST(SphereSet, RefractiveIndex) {
+	SphereSet set({ { Point3(0, 0, -0.25), 1 }, { Point3(0, 0, 0.25), 1 } });
+	set.material = Material::glass();
+
+	Ray r(Point3(0, 0, -4), Vec3(0, 0, 1));
+	IntersectionList xs;
+	set.intersect(r, xs);
+	xs.sort();
+	ASSERT_EQ(xs.size(), 4);
+
+	IntersectionInfo info = xs.info(r, &xs.at(1));
+	EXPECT_EQ(info.n1, 1.52);
+	EXPECT_EQ(info.n2, 1.52);
+	info = xs.info(r, &xs.at(3));
+	EXPECT_EQ(info.n1, 1.52);
+	EXPECT_EQ(info.n2, 1);
+}
+
+// Shades like a group of spheres.
+TEST(SphereSet, World) {
+	auto spheres = make_spheres(20);
+	Material m;
+	m.pattern = std::make_unique<Solid>(Color(0.8, 0.3, 0.2));
+
+	std::vector<std::unique_ptr<Shape>> vec;
+	auto set = std::make_unique<SphereSet>(spheres);
+	set->material = m;
+	vec.push_back(std::move(set));
+	World ws(PointLight(Point3(-10, 10, -10), Color::white()), std::move(vec));
+
+	std::vector<std::unique_ptr<Shape>> single;
+	for (const auto& e : spheres) {
+		auto s = std::make_unique<Sphere>(Matrix4::translate(e.center.x, e.center.y, e.center.z) * Matrix4::scale(e.radius, e.radius, e.radius));
+		s->material = m;
+		single.push_back(std::move(s));
+	}
+	World wg(PointLight(Point3(-10, 10, -10), Color::white()), std::move(single));
+
+	for (int x = -10; x <= 10; x++) {
+		Ray r(Point3(x * 0.35, 0.1, -10), Vec3(0, 0, 1));
+		EXPECT_EQ(ws.color_at(r), wg.color_at(r));
+	}
+}
@@ -0,0 +1,90 @@
+#include "pch.h"
+#include "Stats.h"
+#include "Shape.h"
+#include "Intersect.h"
+#include "World.h"
+#include "Camera.h"
+#include <sstream>
+
+using namespace ray;
+
+// Adding counters sums every field.
+TEST(Stats, Add) {
+	RayStats a;
+	a.camera_rays = 1;
+	a.shadow_rays = 2;
+	a.sphere_tests = 3;
+	RayStats b;
+	b.camera_rays = 10;
+	b.reflection_rays = 20;
+	b.triangle_tests = 30;
+	b.list_heap_allocations = 4;
+	a += b;
+	EXPECT_EQ(a.camera_rays, 11);
+	EXPECT_EQ(a.rays(), 33);
+	EXPECT_EQ(a.primitive_tests(), 33);
+	EXPECT_EQ(a.list_heap_allocations, 4);
+}
+
+// Taking the thread's counters zeroes them.
+TEST(Stats, Take) {
+	RayStats::take();
+	count(&RayStats::cone_tests, 5);
+	RayStats taken = RayStats::take();
+	EXPECT_EQ(taken.cone_tests, stats_enabled ? 5u : 0u);
+	EXPECT_EQ(RayStats::take().cone_tests, 0);
+}
+
+TEST(Stats, Print) {
+	RayStats s;
+	s.camera_rays = 7;
+	s.plane_tests = 3;
+	std::stringstream out;
+	out << s;
+	EXPECT_NE(out.str().find("rays: 7 (camera 7,"), std::string::npos);
+	EXPECT_NE(out.str().find("primitive tests: 3 "), std::string::npos);
+}
+
+// A ray through a group of two spheres visits the group once and tests both spheres.
+TEST(Stats, Intersect) {
+	Group g;
+	auto s1 = std::make_unique<Sphere>();
+	auto s2 = std::make_unique<Sphere>();
+	s2->transform = Matrix4::translate(0, 0, -3);
+	g.add(std::move(s1));
+	g.add(std::move(s2));
+	Ray r(Point3(0, 0, -5), Vec3(0, 0, 1));
+
+	RayStats::take();
+	IntersectionList xs;
+	g.intersect(r, xs);
+	RayStats s = RayStats::take();
+	EXPECT_EQ(xs.size(), 4);
+	if (stats_enabled) {
+		EXPECT_EQ(s.nodes_visited, 1);
+		EXPECT_EQ(s.sphere_tests, 2);
+		EXPECT_EQ(s.primitive_tests(), 2);
+	}
+	else {
+		EXPECT_EQ(s.nodes_visited, 0);
+		EXPECT_EQ(s.primitive_tests(), 0);
+	}
+}
+
+// The camera sums the counters of its threads: one camera ray per pixel, and a shadow ray wherever the default world is hit.
+TEST(Stats, Render) {
+	World w;
+	Camera c(11, 11, pi / 2);
+	c.transform = Matrix4::view(Point3(0, 0, -5), Point3(0, 0, 0), Vec3(0, 1, 0));
+	c.threads = 3;
+	c.verbose = false;
+	c.render(w);
+	if (stats_enabled) {
+		EXPECT_EQ(c.stats.camera_rays, 121);
+		EXPECT_GT(c.stats.shadow_rays, 0);
+		EXPECT_GE(c.stats.primitive_tests(), 2 * c.stats.camera_rays);
+	}
+	else {
+		EXPECT_EQ(c.stats.rays(), 0);
+	}
+}
@@ -0,0 +1,72 @@
+#include "pch.h"
+#include "stress.h"
+#include "BvhReport.h"
+
+// Generated stress scenes: the asked for number of shapes, and the same scene from the same seed.
+
+namespace {
+	StressScene stress(StressScene::Kind kind, size_t count) {
+		StressScene s;
+		s.kind = kind;
+		s.count = count;
+		return s;
+	}
+}
+
+TEST(Stress, Counts) {
+	// the asked for shapes, and the unbounded floor.
+	for (auto kind : { StressScene::Kind::Spheres, StressScene::Kind::TriangleSoup, StressScene::Kind::Nested }) {
+		World world = stress(kind, 500).build();
+		BvhReport report(world);
+		EXPECT_EQ(report.primitives, 501);
+		EXPECT_EQ(report.unbounded, 1);
+	}
+
+	// a grid of whole cells.
+	World grid = stress(StressScene::Kind::TriangleGrid, 500).build();
+	EXPECT_EQ(BvhReport(grid.shapes()).primitives, 15 * 15 * 2);
+}
+
+TEST(Stress, Nested) {
+	StressScene s = stress(StressScene::Kind::Nested, 1000);
+	s.depth = 3;
+	World world = s.build();
+	BvhReport report(world.shapes());
+	EXPECT_EQ(report.primitives, 1000);
+	EXPECT_EQ(report.nodes, 1 + 10 + 100);
+	EXPECT_EQ(report.depth_histogram.size(), 4);
+	EXPECT_EQ(report.depth_histogram[3], 1000);
+}
+
+TEST(Stress, Huge) {
+	StressScene s = stress(StressScene::Kind::Spheres, 100);
+	s.huge = 3;
+	World world = s.build();
+	EXPECT_EQ(BvhReport(world.shapes()).primitives, 103);
+}
+
+TEST(Stress, Seed) {
+	auto colors = [](const StressScene& s) {
+		World world = s.build();
+		Camera camera(20, 10, pi / 3);
+		camera.verbose = false;
+		camera.transform = s.view();
+		return camera.render(world);
+	};
+	StressScene s = stress(StressScene::Kind::Spheres, 200);
+	Canvas a = colors(s);
+	Canvas b = colors(s);
+	s.seed = 2;
+	Canvas c = colors(s);
+
+	bool same = true;
+	bool other = false;
+	for (size_t x = 0; x < a.width(); x++) {
+		for (size_t y = 0; y < a.height(); y++) {
+			same &= a.pixels()[x][y] == b.pixels()[x][y];
+			other |= !(a.pixels()[x][y] == c.pixels()[x][y]);
+		}
+	}
+	EXPECT_TRUE(same);
+	EXPECT_TRUE(other);
+}
@@ -0,0 +1,77 @@
+#include "pch.h"
+#include "Trace.h"
+#include "World.h"
+#include "Camera.h"
+#include <sstream>
+
+using namespace ray;
+
+namespace {
+	// Occurrences of what in s.
+	int occurrences(const std::string& s, const std::string& what) {
+		int n = 0;
+		for (size_t at = s.find(what); at != std::string::npos; at = s.find(what, at + 1)) {
+			n++;
+		}
+		return n;
+	}
+
+	// Writes and clears whatever earlier tests recorded.
+	std::string take_trace() {
+		std::stringstream out;
+		Trace::write(out);
+		return out.str();
+	}
+}
+
+// While off, scopes record nothing.
+TEST(Trace, Disabled) {
+	Trace::stop();
+	take_trace();
+	{
+		TraceScope trace("nothing");
+	}
+	std::string json = take_trace();
+	EXPECT_EQ(occurrences(json, "\"nothing\""), 0);
+	EXPECT_EQ(json.rfind("{\"traceEvents\":[", 0), 0);
+}
+
+// Nested scopes are complete events on the thread's row, the second inside the first. Writing clears them.
+TEST(Trace, Scopes) {
+	take_trace();
+	Trace::start();
+	Trace::name_thread("main");
+	{
+		TraceScope outer("outer");
+		TraceScope inner("inner");
+	}
+	Trace::stop();
+	std::string json = take_trace();
+	int tid = Trace::thread_id();
+	std::string row = "\"pid\":1,\"tid\":" + std::to_string(tid);
+	EXPECT_NE(json.find("{\"name\":\"thread_name\",\"ph\":\"M\"," + row + ",\"args\":{\"name\":\"main\"}}"), std::string::npos);
+	EXPECT_NE(json.find("{\"name\":\"inner\",\"ph\":\"X\"," + row + ",\"ts\":"), std::string::npos);
+	EXPECT_NE(json.find("{\"name\":\"outer\",\"ph\":\"X\"," + row + ",\"ts\":"), std::string::npos);
+	// inner finishes first, so is recorded first.
+	EXPECT_LT(json.find("\"inner\""), json.find("\"outer\""));
+	EXPECT_EQ(occurrences(take_trace(), "\"ph\":\"X\""), 0);
+}
+
+// A traced render has a row per render thread with its columns, and idle time until the frame is done.
+TEST(Trace, Render) {
+	World w;
+	take_trace();
+	Trace::start();
+	Camera c(11, 11, pi / 2);
+	c.transform = Matrix4::view(Point3(0, 0, -5), Point3(0, 0, 0), Vec3(0, 1, 0));
+	c.threads = 2;
+	c.verbose = false;
+	c.render(w);
+	Trace::stop();
+	std::string json = take_trace();
+	EXPECT_EQ(occurrences(json, "\"frame\""), 1);
+	EXPECT_EQ(occurrences(json, "\"column\""), 11);
+	EXPECT_EQ(occurrences(json, "\"idle\""), 2);
+	EXPECT_EQ(occurrences(json, "\"render 0\""), 1);
+	EXPECT_EQ(occurrences(json, "\"render 1\""), 1);
+}
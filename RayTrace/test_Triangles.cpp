@@ -2,6 +2,9 @@
 #include "Tuple.h"
 #include "Shape.h"
 #include "Intersect.h"
+#include "Simd.h"
+#include "RayPacket.h"
+#include <random>
 
 using namespace ray;
 
@@ -145,3 +148,109 @@ TEST(Triangle, Normal) {
 	n = t.local_normal_at(Point3(0.5, 0.25, 0), Intersection(1, &t));
 	EXPECT_EQ(n, t.normal);
 }
+
+// Packed test only drops triangles the ray misses.
+TEST(Triangle, PackHitMask) {
+	Triangle hit(Point3(0, 1, 0), Point3(-1, 0, 0), Point3(1, 0, 0));
+	Triangle miss(Point3(5, 1, 0), Point3(4, 0, 0), Point3(6, 0, 0));
+	Triangle edge(Point3(0, 1, 0), Point3(0, 0, 0), Point3(1, 0, 0));
+	Triangle parallel(Point3(0, 0, 0), Point3(0, 1, 0), Point3(0, 0, 1));
+
+	TrianglePack pack;
+	pack.set(0, &hit, hit.p1, hit.e1, hit.e2);
+	pack.set(1, &miss, miss.p1, miss.e1, miss.e2);
+	pack.set(2, &edge, edge.p1, edge.e1, edge.e2);
+	pack.set(3, &parallel, parallel.p1, parallel.e1, parallel.e2);
+
+	// ray along the edge shared by the first and third triangles.
+	int mask = pack.hit_mask(splat(0), splat(0.5f), splat(-2),
+		splat(0), splat(0), splat(1));
+	EXPECT_EQ(mask, 0x5);
+
+	TrianglePack partial;
+	partial.set(0, &miss, miss.p1, miss.e1, miss.e2);
+	EXPECT_EQ(partial.active, 0x1);
+	EXPECT_EQ(partial.hit_mask(splat(5), splat(0.5f), splat(-2),
+		splat(0), splat(0), splat(1)), 0x1);
+}
+
+// A group of packed triangles finds the same hits as testing each triangle.
+TEST(Triangle, PackedGroupMatches) {
+	Group g;
+	std::vector<const Triangle*> tris;
+	for (int i = 0; i < 7; i++) {
+		auto t = std::make_unique<Triangle>(Point3(0, 1, i), Point3(-1, -1, i + 0.5), Point3(1, -0.5, i - 0.25));
+		tris.push_back(t.get());
+		g.add(std::move(t));
+	}
+	// transformed triangles keep the box test.
+	auto moved = std::make_unique<Triangle>(Point3(0, 1, 0), Point3(-1, -1, 0), Point3(1, -1, 0));
+	moved->transform = Matrix4::translate(0, 0, 20);
+	const Triangle* movedp = moved.get();
+	g.add(std::move(moved));
+
+	for (int x = -10; x <= 10; x++) {
+		for (int y = -10; y <= 10; y++) {
+			Ray r(Point3(x * 0.1, y * 0.1, -5), Vec3(0.01 * x, 0.02, 1).norm());
+			IntersectionList packed;
+			g.intersect(r, packed);
+			packed.sort();
+
+			IntersectionList single;
+			for (auto t : tris) {
+				t->intersect(r, single);
+			}
+			movedp->intersect(r, single);
+			single.sort();
+
+			ASSERT_EQ(packed.size(), single.size());
+			for (size_t i = 0; i < packed.size(); i++) {
+				EXPECT_EQ(packed.at(i).object, single.at(i).object);
+				EXPECT_EQ(packed.at(i).t, single.at(i).t);
+				EXPECT_EQ(packed.at(i).u, single.at(i).u);
+				EXPECT_EQ(packed.at(i).v, single.at(i).v);
+			}
+		}
+	}
+}
+
+// A tiny triangle seen from far away: float rounding of the origin is a large part of the triangle, the packed
+// filter must still pass every ray the double test hits.
+TEST(Triangle, PackHitMaskFarOrigin) {
+	Triangle tri(Point3(0.3, 0.2, 0.1), Point3(0.305, 0.2, 0.1), Point3(0.3, 0.2049, 0.1011));
+	TrianglePack pack;
+	pack.set(0, &tri, tri.p1, tri.e1, tri.e2);
+
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<double> unit(0, 1);
+	int hits = 0;
+	for (double distance : { 10.0, 1e3, 1e5 }) {
+		for (int i = 0; i < 3000; i++) {
+			Point3 origin = Point3(0, 0, 0) + Vec3(unit(rng) - 0.5, unit(rng) - 0.5, -1).norm() * distance;
+			// aim near a vertex or an edge, inside or just outside.
+			double u = unit(rng) < 0.5 ? std::round(unit(rng)) : unit(rng);
+			double v = (1 - u) * (unit(rng) < 0.5 ? std::round(unit(rng)) : unit(rng)) + (unit(rng) - 0.5) * 1e-6;
+			Point3 target = tri.p1 + tri.e1 * u + tri.e2 * v;
+			Ray r(origin, (target - origin).norm());
+
+			IntersectionList exact;
+			tri.local_intersect(r, exact);
+			if (exact.size() == 0) {
+				continue;
+			}
+			hits++;
+			int mask = pack.hit_mask(splat(static_cast<float>(r.origin.x)), splat(static_cast<float>(r.origin.y)),
+				splat(static_cast<float>(r.origin.z)), splat(static_cast<float>(r.direction().x)),
+				splat(static_cast<float>(r.direction().y)), splat(static_cast<float>(r.direction().z)));
+			EXPECT_EQ(mask, 0x1) << "origin " << origin << " target " << target;
+
+			// and tested against a packet of rays.
+			RayPacket packet;
+			packet.add(r);
+			int hits[simd_width];
+			packet.hit_masks(pack, packet.active, hits);
+			EXPECT_EQ(hits[0], 0x1) << "origin " << origin << " target " << target;
+		}
+	}
+	EXPECT_GT(hits, 1000);
+}
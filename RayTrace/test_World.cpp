@@ -197,6 +197,98 @@ TEST(World, ShadowBehindPoint) {
 	EXPECT_EQ(w.is_shadowed(p), false); 
 }
 
+// Light through transparent shapes is dimmed by each surface crossed, opaque shapes stop it.
+TEST(World, LightTransmittance) {
+	std::vector<std::unique_ptr<Shape>> vec;
+	auto pane = std::make_unique<Cube>(Matrix4::translate(0, 5, 0) * Matrix4::scale(10, 0.1, 10));
+	pane->material.transparency = 0.5;
+	vec.push_back(std::move(pane));
+	auto glass = Sphere::glass();
+	glass->transform = Matrix4::translate(5, 2, 0);
+	vec.push_back(std::move(glass));
+	auto wall = std::make_unique<Cube>(Matrix4::translate(-5, 2, 0) * Matrix4::scale(0.5, 0.5, 0.5));
+	vec.push_back(std::move(wall));
+	World w(PointLight(Point3(0, 10, 0), Color::white()), std::move(vec));
+
+	// through both sides of the pane.
+	EXPECT_DOUBLE_EQ(w.light_transmittance(Point3(0, 0, 0)), 0.25);
+	EXPECT_FALSE(w.is_shadowed(Point3(0, 0, 0)));
+	// nothing in the way.
+	EXPECT_DOUBLE_EQ(w.light_transmittance(Point3(0, 9, 0)), 1);
+	// the pane, and then clear glass.
+	EXPECT_DOUBLE_EQ(w.light_transmittance(Point3(10, -6, 0)), 0.25);
+	// the pane, and an opaque cube.
+	EXPECT_EQ(w.light_transmittance(Point3(-10, -6, 0)), 0);
+	EXPECT_TRUE(w.is_shadowed(Point3(-10, -6, 0)));
+}
+
+// Shapes can keep out of shadow rays, and out of camera rays while still showing in mirrors.
+TEST(World, Visibility) {
+	std::vector<std::unique_ptr<Shape>> vec;
+	auto blocker = std::make_unique<Sphere>(Matrix4::translate(0, 5, 0));
+	blocker->cast_shadows = false;
+	vec.push_back(std::move(blocker));
+	auto hidden = std::make_unique<Sphere>(Matrix4::translate(0, 0, 10));
+	hidden->visible_to_camera = false;
+	vec.push_back(std::move(hidden));
+	auto mirror = std::make_unique<Plane>(Matrix4::translate(0, 0, -10) * Matrix4::rotateX(pi / 2));
+	mirror->material.reflective = 1;
+	mirror->material.ambient = 0;
+	mirror->material.diffuse = 0;
+	mirror->material.specular = 0;
+	vec.push_back(std::move(mirror));
+	World w(PointLight(Point3(0, 10, 0), Color::white()), std::move(vec));
+
+	EXPECT_EQ(w.light_transmittance(Point3(0, 0, 0)), 1);
+
+	// the camera looks straight through the hidden sphere, and sees it in the mirror behind.
+	EXPECT_EQ(w.color_at(Ray(Point3(0, 0, 0), Vec3(0, 0, 1))), Color::black());
+	EXPECT_NE(w.color_at(Ray(Point3(0, 0, 0), Vec3(0, 0, -1))), Color::black());
+}
+
+// Lights add up: two half lights shade like one full light.
+TEST(World, Lights) {
+	PointLight full(Point3(-10, 10, -10), Color::white());
+	PointLight half(Point3(-10, 10, -10), Color(0.5, 0.5, 0.5));
+	World one(full);
+	World two(std::vector<PointLight>{ half, half }, World::make_default_shapes());
+	EXPECT_EQ(two.lights().size(), 2);
+	EXPECT_EQ(two.light(), half);
+
+	for (int x = -5; x <= 5; x++) {
+		Ray r(Point3(x * 0.2, 0.1, -5), Vec3(0, 0, 1));
+		EXPECT_EQ(two.color_at(r), one.color_at(r));
+	}
+}
+
+// A light out of range adds nothing, not even ambient.
+TEST(World, LightRange) {
+	PointLight light(Point3(-10, 10, -10), Color::white());
+	World one(light);
+	World two(std::vector<PointLight>{ light, PointLight(Point3(0, 0, -20), Color::white(), 5) }, World::make_default_shapes());
+
+	for (int x = -5; x <= 5; x++) {
+		Ray r(Point3(x * 0.2, 0.1, -5), Vec3(0, 0, 1));
+		EXPECT_EQ(two.color_at(r), one.color_at(r));
+	}
+}
+
+// A sampled light stands in for the others: one sample of two equal lights is scaled to both.
+TEST(World, LightSamples) {
+	PointLight half(Point3(-10, 10, -10), Color(0.5, 0.5, 0.5));
+	RenderSettings settings;
+	World all(std::vector<PointLight>{ half, half }, World::make_default_shapes(), settings);
+	settings.light_samples = 1;
+	World sampled(std::vector<PointLight>{ half, half }, World::make_default_shapes(), settings);
+
+	for (int x = -5; x <= 5; x++) {
+		Ray r(Point3(x * 0.2, 0.1, -5), Vec3(0, 0, 1));
+		EXPECT_EQ(sampled.color_at(r), all.color_at(r));
+		// same point, same pick.
+		EXPECT_EQ(sampled.color_at(r), sampled.color_at(r));
+	}
+}
+
 //Scenario: shade_hit() is given an intersection in shadow
 //  Given w ← world()
 //    And w.light ← point_light(point(0, 0, -10), color(1, 1, 1))
@@ -576,7 +668,8 @@ TEST(World, RefractShade) {
 	IntersectionInfo info = xs.info(r, &xs.at(0));
 	Color c = w.shade(info, 5);
 
-	EXPECT_EQ(c, Color(0.93642, 0.68642, 0.68642));
+	// the book has 0.93642 red: its floor casts a full shadow on the ball, here half the light gets through.
+	EXPECT_EQ(c, Color(1.12547, 0.68642, 0.68642));
 }
 
 //Scenario: shade_hit() with a reflective, transparent material
@@ -632,5 +725,134 @@ TEST(World, RefractShadeTransparent) {
 	IntersectionInfo info = xs.info(r, &xs.at(0));
 	Color c = w.shade(info, 5);
 
-	EXPECT_EQ(c, Color(0.93391, 0.69643, 0.69243));
+	// the book has 0.93391 red, see RefractShade.
+	EXPECT_EQ(c, Color(1.11500, 0.69643, 0.69243));
+}
+
+// Moved shape is hit in its new place, and missed in the old one.
+TEST(World, UpdateTransform) {
+	std::vector<std::unique_ptr<Shape>> vec;
+	Shape* moved = nullptr;
+	for (int i = 0; i < 20; i++) {
+		auto s = std::make_unique<Sphere>(Matrix4::translate(i * 3.0, 0, 0));
+		if (i == 5) {
+			moved = s.get();
+		}
+		vec.push_back(std::move(s));
+	}
+	World w(PointLight(Point3(-10, 10, -10), Color::white()), std::move(vec));
+
+	w.update_transform(moved, Matrix4::translate(15, 10, 0));
+
+	IntersectionList xs;
+	w.intersect(Ray(Point3(15, 10, -5), Vec3(0, 0, 1)), xs);
+	ASSERT_EQ(xs.size(), 2);
+	EXPECT_EQ(xs.at(0).object, moved);
+	EXPECT_EQ(xs.at(0).t, 4);
+
+	IntersectionList old;
+	w.intersect(Ray(Point3(15, 0, -5), Vec3(0, 0, 1)), old);
+	EXPECT_EQ(old.size(), 0);
+}
+
+// Small moves only refit, parent bounds shrink back when the shape returns.
+TEST(World, UpdateTransformRefits) {
+	std::vector<std::unique_ptr<Shape>> vec;
+	Shape* moved = nullptr;
+	for (int i = 0; i < 20; i++) {
+		auto s = std::make_unique<Sphere>(Matrix4::translate(i * 3.0, 0, 0));
+		if (i == 19) {
+			moved = s.get();
+		}
+		vec.push_back(std::move(s));
+	}
+	World w(PointLight(Point3(-10, 10, -10), Color::white()), std::move(vec));
+
+	Group* parent = static_cast<Group*>(moved->parent);
+	ASSERT_NE(parent, nullptr);
+	Bounds built = parent->bounds();
+
+	w.update_transform(moved, Matrix4::translate(57, 0.5, 0));
+	EXPECT_EQ(moved->parent, parent);
+	EXPECT_EQ(parent->bounds().max.y, 1.5);
+
+	w.update_transform(moved, Matrix4::translate(57, 0, 0));
+	EXPECT_EQ(moved->parent, parent);
+	EXPECT_EQ(parent->bounds(), built);
+}
+
+// A shape moved far away makes its old subtree too loose, which is rebuilt.
+TEST(World, UpdateTransformRebuilds) {
+	std::vector<std::unique_ptr<Shape>> vec;
+	Shape* moved = nullptr;
+	for (int i = 0; i < 64; i++) {
+		auto s = std::make_unique<Sphere>(Matrix4::translate((i % 8) * 3.0, (i / 8) * 3.0, 0));
+		if (i == 0) {
+			moved = s.get();
+		}
+		vec.push_back(std::move(s));
+	}
+	RenderSettings settings;
+	settings.build = BuildMode::Sah;
+	World w(PointLight(Point3(-10, 10, -10), Color::white()), std::move(vec), settings);
+
+	// built as a leaf 2 levels down, next to its neighbours.
+	ASSERT_NE(moved->parent, nullptr);
+	ASSERT_NE(moved->parent->parent, nullptr);
+	w.update_transform(moved, Matrix4::translate(100, 100, 0));
+
+	// rebuilding only reorders the old subtree, where the lone sphere now sits right under the root.
+	ASSERT_NE(moved->parent, nullptr);
+	EXPECT_EQ(moved->parent->parent, nullptr);
+
+	// every sphere is still found.
+	for (int i = 0; i < 64; i++) {
+		IntersectionList xs;
+		w.intersect(Ray(Point3((i % 8) * 3.0, (i / 8) * 3.0, -5), Vec3(0, 0, 1)), xs);
+		EXPECT_EQ(xs.size(), i == 0 ? 0 : 2);
+	}
+	IntersectionList xs;
+	w.intersect(Ray(Point3(100, 100, -5), Vec3(0, 0, 1)), xs);
+	EXPECT_EQ(xs.size(), 2);
+}
+
+// A child changed in place after it was added: its groups drop their copies of the old extents and flags.
+TEST(World, Update) {
+	std::vector<std::unique_ptr<Shape>> vec;
+	Cylinder* changed = nullptr;
+	for (int i = 0; i < 20; i++) {
+		if (i == 5) {
+			auto c = std::make_unique<Cylinder>(Matrix4::translate(i * 3.0, 0, 0));
+			c->minimum = -1;
+			c->maximum = 1;
+			changed = c.get();
+			vec.push_back(std::move(c));
+			continue;
+		}
+		vec.push_back(std::make_unique<Sphere>(Matrix4::translate(i * 3.0, 0, 0)));
+	}
+	World w(PointLight(Point3(15, 10, 0), Color::white()), std::move(vec));
+	ASSERT_NE(changed->parent, nullptr);
+
+	changed->minimum = 0;
+	changed->maximum = 4;
+	changed->closed = true;
+	changed->cast_shadows = false;
+	w.update(changed);
+
+	// the closed cap at the new maximum, and the side above the old one.
+	Ray down(Point3(15, 10, 0), Vec3(0, -1, 0));
+	IntersectionList xs;
+	w.intersect(down, xs);
+	ASSERT_EQ(xs.size(), 2);
+	EXPECT_EQ(xs.at(0).object, changed);
+	EXPECT_EQ(xs.at(0).t, 6);
+	EXPECT_EQ(xs.at(1).t, 10);
+
+	Ray side(Point3(15, 3, -5), Vec3(0, 0, 1));
+	IntersectionList above;
+	w.intersect(side, above);
+	EXPECT_EQ(above.size(), 2);
+
+	EXPECT_FALSE(w.is_shadowed(Point3(15, -2, 0)));
 }
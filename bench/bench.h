@@ -0,0 +1,50 @@
+#pragma once
+#include <random>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "Tuple.h"
+#include "Ray.h"
+
+// Inputs shared by the microbenchmarks. Everything is generated from a fixed seed, so runs measure the same work.
+
+namespace ray {
+namespace bench {
+
+	constexpr unsigned seed = 1234;
+	// Inputs per benchmark, a power of 2 so picking the next one is a mask.
+	constexpr size_t input_count = 1024;
+
+	// Rays from a shell 5 to 10 units out, aimed near the origin. Roughly half hit a unit shape there.
+	inline std::vector<Ray> random_rays(size_t n = input_count, unsigned s = seed) {
+		std::mt19937 gen(s);
+		std::uniform_real_distribution<double> unit(-1, 1);
+		std::uniform_real_distribution<double> distance(5, 10);
+		std::vector<Ray> rays;
+		rays.reserve(n);
+		while (rays.size() < n) {
+			Vec3 out(unit(gen), unit(gen), unit(gen));
+			if (out.magnitude() < 0.1) {
+				continue;
+			}
+			Point3 origin = Point3(0, 0, 0) + out.norm() * distance(gen);
+			Point3 target(unit(gen) * 1.5, unit(gen) * 1.5, unit(gen) * 1.5);
+			rays.emplace_back(origin, (target - origin).norm());
+		}
+		return rays;
+	}
+
+	// Points in [-size, size] on every axis.
+	inline std::vector<Point3> random_points(size_t n = input_count, double size = 1, unsigned s = seed) {
+		std::mt19937 gen(s);
+		std::uniform_real_distribution<double> coord(-size, size);
+		std::vector<Point3> points;
+		points.reserve(n);
+		for (size_t i = 0; i < n; i++) {
+			points.emplace_back(coord(gen), coord(gen), coord(gen));
+		}
+		return points;
+	}
+
+} // namespace bench
+} // namespace ray
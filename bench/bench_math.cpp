@@ -0,0 +1,83 @@
+#include "bench.h"
+#include "Matrix.h"
+
+using namespace ray;
+using namespace ray::bench;
+
+// Rotations, scales and translations, each with its inverse cached.
+static std::vector<Matrix4> random_transforms() {
+	std::vector<Point3> p = random_points(input_count * 3, 2);
+	std::vector<Matrix4> m;
+	m.reserve(input_count);
+	for (size_t i = 0; i < input_count; i++) {
+		const Point3& r = p[i * 3];
+		const Point3& s = p[i * 3 + 1];
+		const Point3& t = p[i * 3 + 2];
+		m.push_back(Matrix4::translate(t.x, t.y, t.z) * Matrix4::rotateX(r.x) * Matrix4::rotateY(r.y) * Matrix4::rotateZ(r.z) *
+			Matrix4::scale(std::abs(s.x) + 0.5, std::abs(s.y) + 0.5, std::abs(s.z) + 0.5));
+	}
+	return m;
+}
+
+// Product of two matrices, inverses included.
+static void matrix4_multiply(benchmark::State& state) {
+	std::vector<Matrix4> m = random_transforms();
+	size_t i = 0;
+	for (auto _ : state) {
+		Matrix4 r = m[i & (input_count - 1)] * m[(i + 1) & (input_count - 1)];
+		benchmark::DoNotOptimize(r);
+		i++;
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(matrix4_multiply);
+
+static void matrix4_multiply_point(benchmark::State& state) {
+	std::vector<Matrix4> m = random_transforms();
+	std::vector<Point3> p = random_points();
+	size_t i = 0;
+	for (auto _ : state) {
+		Point3 r = m[i & (input_count - 1)] * p[i & (input_count - 1)];
+		benchmark::DoNotOptimize(r);
+		i++;
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(matrix4_multiply_point);
+
+// World ray into object space, what every Shape::intersect starts with.
+static void matrix4_inverse_multiply_ray(benchmark::State& state) {
+	std::vector<Matrix4> m = random_transforms();
+	std::vector<Ray> rays = random_rays();
+	size_t i = 0;
+	for (auto _ : state) {
+		Ray r = m[i & (input_count - 1)].inverse_multiply(rays[i & (input_count - 1)]);
+		benchmark::DoNotOptimize(r);
+		i++;
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(matrix4_inverse_multiply_ray);
+
+// Full inverse by cofactors, what building a transform costs.
+static void matrix4_inverse_book(benchmark::State& state) {
+	std::vector<Matrix4> m = random_transforms();
+	size_t i = 0;
+	for (auto _ : state) {
+		Matrix4 r = m[i++ & (input_count - 1)].inverse_book();
+		benchmark::DoNotOptimize(r);
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(matrix4_inverse_book);
+
+static void matrix4_transpose(benchmark::State& state) {
+	std::vector<Matrix4> m = random_transforms();
+	size_t i = 0;
+	for (auto _ : state) {
+		Matrix4 r = m[i++ & (input_count - 1)].transpose();
+		benchmark::DoNotOptimize(r);
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(matrix4_transpose);
@@ -0,0 +1,138 @@
+#include "bench.h"
+#include "Pattern.h"
+#include "Material.h"
+#include "Light.h"
+#include "Shape.h"
+#include "Intersect.h"
+
+using namespace ray;
+using namespace ray::bench;
+
+// pattern_at over points in a 4 unit cube, several cells of every pattern.
+static void run_pattern_at(benchmark::State& state, const Pattern& pattern) {
+	std::vector<Point3> points = random_points(input_count, 2);
+	size_t i = 0;
+	for (auto _ : state) {
+		Color c = pattern.pattern_at(points[i++ & (input_count - 1)]);
+		benchmark::DoNotOptimize(c);
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+
+static void pattern_at_stripe(benchmark::State& state) {
+	run_pattern_at(state, Stripe(Color::white(), Color::black()));
+}
+BENCHMARK(pattern_at_stripe);
+
+static void pattern_at_gradient(benchmark::State& state) {
+	run_pattern_at(state, Gradient(Color::white(), Color::black()));
+}
+BENCHMARK(pattern_at_gradient);
+
+static void pattern_at_ring(benchmark::State& state) {
+	run_pattern_at(state, Ring(Color::white(), Color::black()));
+}
+BENCHMARK(pattern_at_ring);
+
+static void pattern_at_checker(benchmark::State& state) {
+	run_pattern_at(state, Checker(Color::white(), Color::black()));
+}
+BENCHMARK(pattern_at_checker);
+
+static void pattern_at_ring_gradient(benchmark::State& state) {
+	run_pattern_at(state, RingGradient(Color::white(), Color::black()));
+}
+BENCHMARK(pattern_at_ring_gradient);
+
+static void pattern_at_join(benchmark::State& state) {
+	run_pattern_at(state, JoinPattern(std::make_unique<Checker>(Color::white(), Color::black()),
+		std::make_unique<Stripe>(Color::white(), Color::black()), std::make_unique<Ring>(Color::white(), Color::black())));
+}
+BENCHMARK(pattern_at_join);
+
+static void pattern_at_perlin(benchmark::State& state) {
+	run_pattern_at(state, PerlinPattern(std::make_unique<Stripe>(Color::white(), Color::black()), 0.3f));
+}
+BENCHMARK(pattern_at_perlin);
+
+// Phong lighting at points on a unit sphere, seen and lit from random directions.
+static void material_lighting(benchmark::State& state) {
+	std::vector<Point3> points = random_points();
+	std::vector<Point3> eyes = random_points(input_count, 1, seed + 1);
+	Material m;
+	PointLight light(Point3(-10, 10, -10), Color::white());
+	std::vector<Vec3> normals;
+	std::vector<Vec3> eyev;
+	for (size_t i = 0; i < input_count; i++) {
+		normals.push_back((points[i] - Point3(0, 0, 0)).norm());
+		eyev.push_back((eyes[i] - Point3(0, 0, 0)).norm());
+	}
+
+	size_t i = 0;
+	for (auto _ : state) {
+		size_t k = i++ & (input_count - 1);
+		Color c = m.lighting(light, Color(0.8, 0.5, 0.2), points[k] + normals[k], eyev[k], normals[k], 1.0);
+		benchmark::DoNotOptimize(c);
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(material_lighting);
+
+// range(0) hits at random t, appended then sorted, as World::intersect does per ray.
+static void intersection_list_append_sort(benchmark::State& state) {
+	std::vector<Point3> t = random_points(input_count, 10);
+	Sphere s;
+	size_t n = state.range(0);
+	IntersectionList xs;
+	size_t i = 0;
+	for (auto _ : state) {
+		xs.clear();
+		for (size_t h = 0; h < n; h++) {
+			xs.append(Intersection(t[(i + h) & (input_count - 1)].x, &s));
+		}
+		xs.sort();
+		benchmark::DoNotOptimize(xs.size());
+		i++;
+	}
+	state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(intersection_list_append_sort)->Arg(2)->Arg(16)->Arg(128);
+
+// Nearest non negative hit of an unsorted list, what shading a camera ray needs.
+static void intersection_list_hit(benchmark::State& state) {
+	std::vector<Point3> t = random_points(input_count, 10);
+	Sphere s;
+	IntersectionList xs;
+	for (int h = 0; h < state.range(0); h++) {
+		xs.append(Intersection(t[h].x, &s));
+	}
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(xs.hit());
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(intersection_list_hit)->Arg(2)->Arg(16)->Arg(128);
+
+// Refraction info at the far side of a row of glass spheres, walking every hit before it.
+static void intersection_list_info(benchmark::State& state) {
+	std::vector<std::unique_ptr<Sphere>> spheres;
+	for (int i = 0; i < 8; i++) {
+		auto s = Sphere::glass();
+		s->transform = Matrix4::translate(0, 0, i * 3.0);
+		spheres.push_back(std::move(s));
+	}
+	Ray r(Point3(0, 0, -5), Vec3(0, 0, 1));
+	IntersectionList xs;
+	for (const auto& s : spheres) {
+		s->intersect(r, xs);
+	}
+	xs.sort();
+	const Intersection* last = &xs.at(xs.size() - 1);
+
+	for (auto _ : state) {
+		IntersectionInfo info = xs.info(r, last);
+		benchmark::DoNotOptimize(info.n1);
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(intersection_list_info);
@@ -0,0 +1,98 @@
+#include "bench.h"
+#include "Shape.h"
+#include "Intersect.h"
+#include "SphereSet.h"
+
+using namespace ray;
+using namespace ray::bench;
+
+// One local_intersect per iteration, cycling through the same random rays.
+static void run_local_intersect(benchmark::State& state, const Shape& shape) {
+	std::vector<Ray> rays = random_rays();
+	IntersectionList xs;
+	size_t i = 0;
+	for (auto _ : state) {
+		xs.clear();
+		shape.local_intersect(rays[i++ & (input_count - 1)], xs);
+		benchmark::DoNotOptimize(xs.size());
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+
+static void sphere_local_intersect(benchmark::State& state) {
+	run_local_intersect(state, Sphere());
+}
+BENCHMARK(sphere_local_intersect);
+
+static void cube_local_intersect(benchmark::State& state) {
+	run_local_intersect(state, Cube());
+}
+BENCHMARK(cube_local_intersect);
+
+static void cylinder_local_intersect(benchmark::State& state) {
+	Cylinder cyl;
+	cyl.minimum = -1;
+	cyl.maximum = 1;
+	cyl.closed = true;
+	run_local_intersect(state, cyl);
+}
+BENCHMARK(cylinder_local_intersect);
+
+static void cone_local_intersect(benchmark::State& state) {
+	Cone cone;
+	cone.minimum = -1;
+	cone.maximum = 1;
+	cone.closed = true;
+	run_local_intersect(state, cone);
+}
+BENCHMARK(cone_local_intersect);
+
+static void triangle_local_intersect(benchmark::State& state) {
+	run_local_intersect(state, Triangle(Point3(0, 1, 0), Point3(-1, -1, 0.5), Point3(1, -1, -0.5)));
+}
+BENCHMARK(triangle_local_intersect);
+
+// range(0) spheres of radius 0.05 to 0.1 spread over the unit cube, under a hierarchy from each builder.
+static std::vector<std::unique_ptr<Shape>> random_spheres(size_t n) {
+	std::vector<Point3> centers = random_points(n);
+	std::vector<std::unique_ptr<Shape>> shapes;
+	for (size_t i = 0; i < n; i++) {
+		double r = 0.05 + 0.05 * (i % 5) / 4;
+		shapes.push_back(std::make_unique<Sphere>(Matrix4::translate(centers[i].x, centers[i].y, centers[i].z) * Matrix4::scale(r, r, r)));
+	}
+	return shapes;
+}
+
+static void group_local_intersect(benchmark::State& state, BuildMode mode) {
+	Group g;
+	for (auto& s : NoopGroup::build(random_spheres(state.range(0)), mode)) {
+		g.add(std::move(s));
+	}
+	run_local_intersect(state, g);
+}
+BENCHMARK_CAPTURE(group_local_intersect, bucket, BuildMode::Bucket)->Arg(64)->Arg(4096);
+BENCHMARK_CAPTURE(group_local_intersect, lbvh, BuildMode::Lbvh)->Arg(64)->Arg(4096);
+BENCHMARK_CAPTURE(group_local_intersect, sah, BuildMode::Sah)->Arg(64)->Arg(4096);
+
+// A flat group of range(0) untransformed triangles, which Group tests in SIMD packs.
+static void group_local_intersect_mesh(benchmark::State& state) {
+	std::vector<Point3> points = random_points(state.range(0) * 3);
+	Group g;
+	for (size_t i = 0; i + 2 < points.size(); i += 3) {
+		Vec3 e1 = (points[i + 1] - points[i]) * 0.1;
+		Vec3 e2 = (points[i + 2] - points[i]) * 0.1;
+		g.add(std::make_unique<Triangle>(points[i], points[i] + e1, points[i] + e2));
+	}
+	run_local_intersect(state, g);
+}
+BENCHMARK(group_local_intersect_mesh)->Arg(16)->Arg(256);
+
+static void sphere_set_local_intersect(benchmark::State& state) {
+	std::vector<Point3> centers = random_points(state.range(0));
+	std::vector<SphereSet::Entry> entries;
+	for (const auto& c : centers) {
+		entries.push_back({ c, 0.05 });
+	}
+	run_local_intersect(state, SphereSet(entries));
+}
+BENCHMARK(sphere_set_local_intersect)->Arg(64)->Arg(4096);
@@ -0,0 +1,545 @@
+#include "pch.h"
+#include <array>
+#include <atomic>
+#include <future>
+#include <thread>
+
+#include "Bvh.h"
+#include "Shape.h"
+#include "Trace.h"
+
+using namespace ray;
+
+namespace {
+	// Below this many items a loop isn't worth starting threads for.
+	constexpr size_t parallel_min = 4096;
+
+	size_t worker_count(size_t n) {
+		if (n < parallel_min) {
+			return 1;
+		}
+		return std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency(), n / parallel_min));
+	}
+
+	// Calls f(worker, begin, end) on workers contiguous slices of [0, n).
+	template <typename F>
+	void parallel_chunks(size_t n, size_t workers, F f) {
+		size_t chunk = (n + workers - 1) / workers;
+		std::vector<std::thread> threads;
+		for (size_t w = 1; w < workers; w++) {
+			size_t begin = std::min(n, w * chunk);
+			size_t end = std::min(n, begin + chunk);
+			threads.emplace_back([&f, w, begin, end] { f(w, begin, end); });
+		}
+		f(0, 0, std::min(n, chunk));
+		for (auto& t : threads) {
+			t.join();
+		}
+	}
+
+	// Spreads the low 10 bits of v out to every 3rd bit.
+	uint32_t expand_bits(uint32_t v) {
+		v = (v * 0x00010001u) & 0xFF0000FFu;
+		v = (v * 0x00000101u) & 0x0F00F00Fu;
+		v = (v * 0x00000011u) & 0xC30C30C3u;
+		v = (v * 0x00000005u) & 0x49249249u;
+		return v;
+	}
+
+	uint32_t quantize(double d) {
+		return static_cast<uint32_t>(std::clamp(d * 1024, 0.0, 1023.0));
+	}
+
+	// Emits wide nodes over contiguous ranges of an ordered primitive list.
+	// Builder supplies:
+	//	size_t split(first, last, depth): orders [first, last) and returns where to cut it in two
+	//	double weight(first, last): priority for opening a range into a binary split
+	//	std::unique_ptr<Shape> leaf(i): takes the shape at position i
+	template <typename Builder>
+	class WideEmitter {
+	public:
+		// Children of the node over range [first, last).
+		// Binary splits are opened heaviest first until the node is simd_width wide, giving wide nodes directly.
+		std::vector<std::unique_ptr<Shape>> children(size_t first, size_t last, int depth) {
+			Builder& builder = static_cast<Builder&>(*this);
+
+			struct Range {
+				size_t first;
+				size_t last;
+				double weight;
+			};
+			std::vector<Range> ranges = { { first, last, 0 } };
+			while (ranges.size() < simd_width) {
+				auto heaviest = ranges.end();
+				for (auto it = ranges.begin(); it != ranges.end(); ++it) {
+					if (it->last - it->first > 1 && (heaviest == ranges.end() || it->weight > heaviest->weight)) {
+						heaviest = it;
+					}
+				}
+				if (heaviest == ranges.end()) {
+					break;
+				}
+
+				Range range = *heaviest;
+				size_t mid = builder.split(range.first, range.last, depth);
+				*heaviest = { range.first, mid, builder.weight(range.first, mid) };
+				ranges.insert(heaviest + 1, { mid, range.last, builder.weight(mid, range.last) });
+			}
+
+			// Big subtrees are independent, they're built on other threads while the budget lasts.
+			// We build the biggest, and whatever didn't get a thread, ourselves.
+			size_t biggest = 0;
+			for (size_t i = 1; i < ranges.size(); i++) {
+				if (ranges[i].last - ranges[i].first > ranges[biggest].last - ranges[biggest].first) {
+					biggest = i;
+				}
+			}
+			std::vector<std::future<std::unique_ptr<Shape>>> futures(ranges.size());
+			for (size_t i = 0; i < ranges.size(); i++) {
+				Range r = ranges[i];
+				if (i != biggest && r.last - r.first >= parallel_min && take_thread()) {
+					futures[i] = std::async(std::launch::async, [this, r, depth] {
+						auto subtree = node(r.first, r.last, depth + 1);
+						_spare_threads++;
+						return subtree;
+						});
+				}
+			}
+			std::vector<std::unique_ptr<Shape>> ret(ranges.size());
+			for (size_t i = 0; i < ranges.size(); i++) {
+				if (!futures[i].valid()) {
+					ret[i] = node(ranges[i].first, ranges[i].last, depth + 1);
+				}
+			}
+			for (size_t i = 0; i < ranges.size(); i++) {
+				if (futures[i].valid()) {
+					ret[i] = futures[i].get();
+				}
+			}
+			return ret;
+		}
+
+	private:
+		// Threads subtree builds may still start, shared by the whole build: one per hardware thread, less ours.
+		std::atomic<int> _spare_threads{ static_cast<int>(std::max(1u, std::thread::hardware_concurrency())) - 1 };
+
+		bool take_thread() {
+			int spare = _spare_threads.load();
+			while (spare > 0) {
+				if (_spare_threads.compare_exchange_weak(spare, spare - 1)) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		std::unique_ptr<Shape> node(size_t first, size_t last, int depth) {
+			if (last - first == 1) {
+				return static_cast<Builder&>(*this).leaf(first);
+			}
+
+			auto group = std::make_unique<NoopGroup>();
+			for (auto& c : children(first, last, depth)) {
+				group->add(std::move(c));
+			}
+			return group;
+		}
+	};
+
+	// Splits shapes sorted in Morton order on code bits.
+	class LbvhBuilder : public WideEmitter<LbvhBuilder> {
+	public:
+		LbvhBuilder(std::vector<std::unique_ptr<Shape>>& shapes, const std::vector<MortonPrim>& prims) : _shapes(shapes), _prims(prims) {
+			size_t n = prims.size();
+			if (n < 2) {
+				return;
+			}
+
+			// Split level of each adjacent pair of codes: leading bits the two have in common. Runs of equal codes
+			// are halved, their pairs ranked below every code bit by how deep the halving reaches them.
+			_level.resize(n - 1);
+			for (size_t i = 0; i + 1 < n; i++) {
+				uint32_t diff = prims[i].code ^ prims[i + 1].code;
+				_level[i] = diff == 0 ? -1 : leading_zeros(diff);
+			}
+			for (size_t first = 0; first < n;) {
+				size_t last = first + 1;
+				while (last < n && prims[last].code == prims[first].code) {
+					last++;
+				}
+				halve(first, last, 32);
+				first = last;
+			}
+
+			// The tree is the Cartesian tree of the levels: every range splits at its pair with the fewest common bits.
+			// Built in one pass with a stack of the right spine.
+			_left.assign(n - 1, -1);
+			_right.assign(n - 1, -1);
+			std::vector<int64_t> spine;
+			for (size_t i = 0; i + 1 < n; i++) {
+				int64_t below = -1;
+				while (!spine.empty() && _level[spine.back()] > _level[i]) {
+					below = spine.back();
+					spine.pop_back();
+				}
+				_left[i] = below;
+				if (!spine.empty()) {
+					_right[spine.back()] = static_cast<int64_t>(i);
+				}
+				spine.push_back(static_cast<int64_t>(i));
+			}
+			_root = spine.front();
+		}
+
+		std::unique_ptr<Shape> leaf(size_t i) {
+			return std::move(_shapes[_prims[i].index]);
+		}
+
+		// Ranges with the most shapes are opened first, code ranges don't carry bounds.
+		double weight(size_t first, size_t last) const {
+			return static_cast<double>(last - first);
+		}
+
+		// Returns first index of [first, last) past the range's split pair. Every range is a node of the tree, and
+		// the child of whichever pair just outside it splits at more common bits, so this is a lookup.
+		size_t split(size_t first, size_t last, int) const {
+			size_t n = _prims.size();
+			int64_t pair = _root;
+			if (first > 0 && (last == n || _level[first - 1] > _level[last - 1])) {
+				pair = _right[first - 1];
+			}
+			else if (last < n) {
+				pair = _left[last - 1];
+			}
+			return static_cast<size_t>(pair) + 1;
+		}
+
+	private:
+		std::vector<std::unique_ptr<Shape>>& _shapes;
+		const std::vector<MortonPrim>& _prims;
+		// _level[i]: split level of prims i and i + 1. _left[i], _right[i]: split pairs of the two sides of pair i,
+		// -1 for a single prim.
+		std::vector<int> _level;
+		std::vector<int64_t> _left;
+		std::vector<int64_t> _right;
+		int64_t _root = -1;
+
+		static int leading_zeros(uint32_t x) {
+			int n = 0;
+			for (int shift = 16; shift > 0; shift >>= 1) {
+				if ((x >> (32 - shift)) == 0) {
+					n += shift;
+					x <<= shift;
+				}
+			}
+			return n;
+		}
+
+		// Levels of the pairs in run [first, last) of equal codes, splitting it in the middle, level deep.
+		void halve(size_t first, size_t last, int level) {
+			if (last - first < 2) {
+				return;
+			}
+			size_t mid = first + (last - first) / 2;
+			_level[mid - 1] = level;
+			halve(first, mid, level + 1);
+			halve(mid, last, level + 1);
+		}
+	};
+
+	// Shape bounds in parent space, with their center.
+	struct SahPrim {
+		Bounds bounds;
+		Point3 center;
+		uint32_t index;
+	};
+
+	// Splits ranges of prims where the surface area heuristic cost is lowest, reordering prims in place.
+	class SahBuilder : public WideEmitter<SahBuilder> {
+	public:
+		SahBuilder(std::vector<std::unique_ptr<Shape>>& shapes, std::vector<SahPrim>& prims) : _shapes(shapes), _prims(prims) {}
+
+		std::unique_ptr<Shape> leaf(size_t i) {
+			return std::move(_shapes[_prims[i].index]);
+		}
+
+		// Biggest surface area first, those nodes are entered by the most rays.
+		double weight(size_t first, size_t last) const {
+			Bounds b;
+			for (size_t i = first; i < last; i++) {
+				b.add(_prims[i].bounds);
+			}
+			return b.surface_area();
+		}
+
+		size_t split(size_t first, size_t last, int depth) {
+			// Only the root bins on several threads, below it subtrees are already running in parallel.
+			size_t workers = depth == 0 ? worker_count(last - first) : 1;
+
+			// Pick axis with the widest spread of centers.
+			std::vector<Bounds> partial(workers);
+			parallel_chunks(last - first, workers, [&](size_t w, size_t begin, size_t end) {
+				for (size_t i = first + begin; i < first + end; i++) {
+					partial[w].add(_prims[i].center);
+				}
+				});
+			Bounds centers;
+			for (const auto& b : partial) {
+				centers.add(b);
+			}
+			Vec3 extent = centers.max - centers.min;
+			int axis = 0;
+			if (extent.y > extent.x) {
+				axis = 1;
+			}
+			if (extent.z > (axis == 0 ? extent.x : extent.y)) {
+				axis = 2;
+			}
+			double lo = component(centers.min, axis);
+			double width = component(extent, axis);
+
+			size_t mid = first + (last - first) / 2;
+			if (width <= 0) {
+				// all centers in one spot, nothing to split on.
+				return mid;
+			}
+
+			// Bin prims by center along axis.
+			auto bin_of = [&](const SahPrim& p) {
+				int bin = static_cast<int>((component(p.center, axis) - lo) / width * bins);
+				return std::min(bin, bins - 1);
+			};
+
+			std::vector<std::array<Bin, bins>> partial_bins(workers);
+			parallel_chunks(last - first, workers, [&](size_t w, size_t begin, size_t end) {
+				for (size_t i = first + begin; i < first + end; i++) {
+					Bin& bin = partial_bins[w][bin_of(_prims[i])];
+					bin.bounds.add(_prims[i].bounds);
+					bin.count++;
+				}
+				});
+			// Note: empty bins are skipped, adding empty (inverted) bounds to a Bounds grows it to infinity.
+			std::array<Bin, bins> bin;
+			for (const auto& p : partial_bins) {
+				for (int i = 0; i < bins; i++) {
+					if (p[i].count > 0) {
+						bin[i].bounds.add(p[i].bounds);
+						bin[i].count += p[i].count;
+					}
+				}
+			}
+
+			// Sweep from the right for the cost of everything right of each plane, then from the left for the rest.
+			std::array<double, bins> right_cost;
+			Bounds right;
+			size_t right_count = 0;
+			for (int i = bins - 1; i > 0; i--) {
+				if (bin[i].count > 0) {
+					right.add(bin[i].bounds);
+					right_count += bin[i].count;
+				}
+				right_cost[i] = right.surface_area() * right_count;
+			}
+
+			int best = -1;
+			double best_cost = std::numeric_limits<double>::max();
+			Bounds left;
+			size_t left_count = 0;
+			for (int i = 1; i < bins; i++) {
+				if (bin[i - 1].count > 0) {
+					left.add(bin[i - 1].bounds);
+					left_count += bin[i - 1].count;
+				}
+				if (left_count == 0 || left_count == last - first) {
+					continue;
+				}
+				double cost = left.surface_area() * left_count + right_cost[i];
+				if (cost < best_cost) {
+					best_cost = cost;
+					best = i;
+				}
+			}
+
+			if (best < 0) {
+				return mid;
+			}
+
+			auto it = std::partition(_prims.begin() + first, _prims.begin() + last, [&](const SahPrim& p) {
+				return bin_of(p) < best;
+				});
+			return it - _prims.begin();
+		}
+
+	private:
+		static constexpr int bins = 16;
+
+		struct Bin {
+			Bounds bounds;
+			size_t count = 0;
+		};
+
+		std::vector<std::unique_ptr<Shape>>& _shapes;
+		std::vector<SahPrim>& _prims;
+
+		template <typename T>
+		static double component(const T& t, int axis) {
+			return axis == 0 ? t.x : (axis == 1 ? t.y : t.z);
+		}
+	};
+
+}
+
+uint32_t ray::morton_code(double x, double y, double z) {
+	return (expand_bits(quantize(x)) << 2) | (expand_bits(quantize(y)) << 1) | expand_bits(quantize(z));
+}
+
+void ray::radix_sort(std::vector<MortonPrim>& prims) {
+	size_t n = prims.size();
+	size_t workers = worker_count(n);
+	std::vector<MortonPrim> sorted(n);
+
+	// Even pass count, so the result ends up back in prims.
+	for (int shift = 0; shift < 32; shift += 8) {
+		// Per worker digit counts, turned into per worker scatter offsets.
+		// Worker w writes each digit after workers < w, keeping the sort stable.
+		std::vector<std::array<size_t, 256>> offsets(workers);
+		parallel_chunks(n, workers, [&](size_t w, size_t begin, size_t end) {
+			offsets[w].fill(0);
+			for (size_t i = begin; i < end; i++) {
+				offsets[w][(prims[i].code >> shift) & 0xFF]++;
+			}
+			});
+
+		size_t sum = 0;
+		for (size_t digit = 0; digit < 256; digit++) {
+			for (size_t w = 0; w < workers; w++) {
+				size_t count = offsets[w][digit];
+				offsets[w][digit] = sum;
+				sum += count;
+			}
+		}
+
+		parallel_chunks(n, workers, [&](size_t w, size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				sorted[offsets[w][(prims[i].code >> shift) & 0xFF]++] = prims[i];
+			}
+			});
+
+		prims.swap(sorted);
+	}
+}
+
+std::vector<std::unique_ptr<Shape>> NoopGroup::take_unbounded(std::vector<std::unique_ptr<Shape>>& shapes) {
+	std::vector<std::unique_ptr<Shape>> unbounded;
+	auto it = std::stable_partition(shapes.begin(), shapes.end(), [](const auto& s) {
+		return s->bounds().is_finite();
+		});
+	std::move(it, shapes.end(), std::back_inserter(unbounded));
+	shapes.erase(it, shapes.end());
+	return unbounded;
+}
+
+std::vector<std::unique_ptr<Shape>> NoopGroup::build(std::vector<std::unique_ptr<Shape>>&& shapes, BuildMode mode) {
+	switch (mode) {
+	case BuildMode::Lbvh: {
+		TraceScope trace("NoopGroup::lbvh");
+		return lbvh(std::move(shapes));
+	}
+	case BuildMode::Sah: {
+		TraceScope trace("NoopGroup::sah");
+		return sah(std::move(shapes));
+	}
+	case BuildMode::Bucket:
+	default: {
+		TraceScope trace("NoopGroup::spatialize");
+		return spatialize(std::move(shapes));
+	}
+	}
+}
+
+// Linear BVH (Karras 2012 style, built top down). Algorithm:
+// 1. compute bounds in parent space, set aside unbounded shapes (they can't be placed on the curve)
+// 2. Morton code of each shape's center, quantized in the bounds of all centers
+// 3. radix sort by code
+// 4. for each adjacent pair of codes, the bits they have in common. A range splits at its pair with the fewest,
+//		ie. at the highest differing code bit, which halves space along one axis.
+// 5. the tree of those splits is built in one pass over the pairs, so emitting it is O(n).
+std::vector<std::unique_ptr<Shape>> NoopGroup::lbvh(std::vector<std::unique_ptr<Shape>>&& shapes) {
+	if (shapes.size() < 8) {
+		// same cutoff as spatialize
+		return std::move(shapes);
+	}
+
+	std::vector<std::unique_ptr<Shape>> unbounded = take_unbounded(shapes);
+
+	size_t n = shapes.size();
+	size_t workers = worker_count(n);
+
+	// Centers in parent space.
+	std::vector<Point3> centers(n);
+	std::vector<Bounds> center_bounds(workers);
+	parallel_chunks(n, workers, [&](size_t w, size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			Bounds b = shapes[i]->parent_bounds();
+			centers[i] = Point3((b.min.x + b.max.x) / 2, (b.min.y + b.max.y) / 2, (b.min.z + b.max.z) / 2);
+			center_bounds[w].add(centers[i]);
+		}
+		});
+
+	Bounds cb;
+	for (const auto& b : center_bounds) {
+		cb.add(b);
+	}
+	Vec3 extent = cb.max - cb.min;
+	Vec3 scale(extent.x > 0 ? 1 / extent.x : 0, extent.y > 0 ? 1 / extent.y : 0, extent.z > 0 ? 1 / extent.z : 0);
+
+	std::vector<MortonPrim> prims(n);
+	parallel_chunks(n, workers, [&](size_t, size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			Vec3 offset = centers[i] - cb.min;
+			prims[i].code = morton_code(offset.x * scale.x, offset.y * scale.y, offset.z * scale.z);
+			prims[i].index = static_cast<uint32_t>(i);
+		}
+		});
+
+	radix_sort(prims);
+
+	std::vector<std::unique_ptr<Shape>> ret;
+	if (n > 0) {
+		ret = LbvhBuilder(shapes, prims).children(0, n, 0);
+	}
+	ret.insert(ret.end(), std::make_move_iterator(unbounded.begin()), std::make_move_iterator(unbounded.end()));
+	return ret;
+}
+
+// Binned SAH (Wald 2007). Algorithm:
+// 1. compute bounds in parent space, set aside unbounded shapes
+// 2. foreach node: bin centers into 16 slots along the axis they spread most on
+// 3. sweep the 15 planes between bins, cost = surface area * shape count, summed over both sides
+// 4. partition at the cheapest plane, opening sides until the node is 4 wide
+// 5. the root's binning runs on several threads, and big subtrees on threads of their own while there are
+//		hardware threads to spare
+std::vector<std::unique_ptr<Shape>> NoopGroup::sah(std::vector<std::unique_ptr<Shape>>&& shapes) {
+	if (shapes.size() < 8) {
+		// same cutoff as spatialize
+		return std::move(shapes);
+	}
+
+	std::vector<std::unique_ptr<Shape>> unbounded = take_unbounded(shapes);
+
+	size_t n = shapes.size();
+	std::vector<SahPrim> prims(n);
+	parallel_chunks(n, worker_count(n), [&](size_t, size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			Bounds b = shapes[i]->parent_bounds();
+			prims[i] = { b, Point3((b.min.x + b.max.x) / 2, (b.min.y + b.max.y) / 2, (b.min.z + b.max.z) / 2), static_cast<uint32_t>(i) };
+		}
+		});
+
+	std::vector<std::unique_ptr<Shape>> ret;
+	if (n > 0) {
+		ret = SahBuilder(shapes, prims).children(0, n, 0);
+	}
+	ret.insert(ret.end(), std::make_move_iterator(unbounded.begin()), std::make_move_iterator(unbounded.end()));
+	return ret;
+}
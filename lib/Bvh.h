@@ -0,0 +1,22 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Building blocks of the linear BVH builder (NoopGroup::lbvh), also used to order SphereSet blocks.
+
+namespace ray {
+
+	// Position of a shape on the Morton curve, and its index in the shape list.
+	struct MortonPrim {
+		uint32_t code;
+		uint32_t index;
+	};
+
+	// 30 bit Morton code of a point in the unit cube: bits of x, y and z interleaved, 10 per axis.
+	// Points close in space get close codes, so sorting by code gives spatial locality.
+	uint32_t morton_code(double x, double y, double z);
+
+	// Stable sort by code. LSD radix sort, 8 bits per pass, each pass split over threads.
+	void radix_sort(std::vector<MortonPrim>& prims);
+
+} // namespace ray
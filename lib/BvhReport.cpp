@@ -0,0 +1,132 @@
+#include "pch.h"
+#include <algorithm>
+
+#include "BvhReport.h"
+
+using namespace ray;
+
+namespace {
+	// Bounds of shape, in the space to_world takes its parent's space to.
+	Bounds bounds_in(const Shape& shape, const Matrix4& to_world) {
+		Matrix4 m = to_world * shape.transform;
+		Bounds b;
+		for (const auto& p : shape.bounds().corners()) {
+			b.add(m * p);
+		}
+		return b;
+	}
+
+	// Where a and b overlap, inverted (so no surface area) if they don't.
+	Bounds overlap(const Bounds& a, const Bounds& b) {
+		return Bounds(Point3(std::max(a.min.x, b.min.x), std::max(a.min.y, b.min.y), std::max(a.min.z, b.min.z)),
+			Point3(std::min(a.max.x, b.max.x), std::min(a.max.y, b.max.y), std::min(a.max.z, b.max.z)));
+	}
+
+	void bump(std::vector<size_t>& histogram, size_t i) {
+		if (histogram.size() <= i) {
+			histogram.resize(i + 1);
+		}
+		histogram[i]++;
+	}
+}
+
+BvhReport::BvhReport(const std::vector<std::unique_ptr<Shape>>& shapes) {
+	Bounds all;
+	for (const auto& s : shapes) {
+		Bounds b = s->parent_bounds();
+		if (b.is_finite()) {
+			all.add(b);
+		}
+	}
+	double root_area = all.surface_area();
+	double half_volume = all.area() / 2;
+
+	size_t overlap_groups = 0;
+	for (const auto& s : shapes) {
+		if (const Group* g = dynamic_cast<const Group*>(s.get())) {
+			visit(*g, Matrix4::identity(), 0, root_area, overlap_groups);
+			continue;
+		}
+		Bounds b = s->parent_bounds();
+		if (!b.is_finite()) {
+			unbounded++;
+		}
+		else {
+			top_level++;
+			if (b.area() >= half_volume) {
+				huge++;
+			}
+		}
+		primitives++;
+		bump(depth_histogram, 0);
+		expected_primitive_tests += 1;
+	}
+
+	if (overlap_groups > 0) {
+		sibling_overlap /= overlap_groups;
+	}
+	sah_cost = expected_node_visits + expected_primitive_tests;
+}
+
+BvhReport::BvhReport(const World& world) : BvhReport(world.shapes()) {
+	for (size_t i = 0; i < world.unbounded().size(); i++) {
+		unbounded++;
+		primitives++;
+		bump(depth_histogram, 0);
+		expected_primitive_tests += 1;
+	}
+	sah_cost = expected_node_visits + expected_primitive_tests;
+}
+
+void BvhReport::visit(const Group& group, const Matrix4& to_world, size_t depth, double root_area, size_t& overlap_groups) {
+	nodes++;
+	expected_node_visits += root_area > 0 ? bounds_in(group, to_world).surface_area() / root_area : 1;
+
+	Matrix4 inner = to_world * group.transform;
+	size_t leaves = 0;
+	std::vector<Bounds> children;
+	for (const auto& c : group.shapes()) {
+		children.push_back(c->parent_bounds());
+		if (const Group* g = dynamic_cast<const Group*>(c.get())) {
+			visit(*g, inner, depth + 1, root_area, overlap_groups);
+			continue;
+		}
+		leaves++;
+		primitives++;
+		bump(depth_histogram, depth + 1);
+		max_depth = std::max(max_depth, depth + 1);
+		expected_primitive_tests += root_area > 0 ? bounds_in(*c, inner).surface_area() / root_area : 1;
+	}
+	bump(leaf_sizes, leaves);
+
+	double area = group.bounds().surface_area();
+	if (children.size() >= 2 && area > 0) {
+		double shared = 0;
+		for (size_t i = 0; i < children.size(); i++) {
+			for (size_t j = i + 1; j < children.size(); j++) {
+				shared += overlap(children[i], children[j]).surface_area();
+			}
+		}
+		sibling_overlap += shared / area;
+		overlap_groups++;
+	}
+}
+
+namespace ray {
+	std::ostream& operator<<(std::ostream& os, const BvhReport& r) {
+		os << "nodes: " << r.nodes << ", primitives: " << r.primitives << ", max depth: " << r.max_depth << "\n";
+		os << "top level: " << r.top_level << " (huge " << r.huge << "), unbounded: " << r.unbounded << "\n";
+		os << "primitives by depth:";
+		for (size_t n : r.depth_histogram) {
+			os << " " << n;
+		}
+		os << "\ngroups by primitive children:";
+		for (size_t n : r.leaf_sizes) {
+			os << " " << n;
+		}
+		os << "\nsibling overlap: " << r.sibling_overlap << "\n";
+		os << "per ray: " << r.expected_node_visits << " node visits, " << r.expected_primitive_tests << " primitive tests, sah cost "
+			<< r.sah_cost << "\n";
+		return os;
+	}
+}
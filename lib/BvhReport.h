@@ -0,0 +1,49 @@
+#pragma once
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include "Shape.h"
+#include "World.h"
+
+namespace ray {
+
+	// Quality of a built hierarchy (World::shapes(), or what NoopGroup::build returns), to judge builders without
+	// rendering. Expectations are per random ray through the bounds of all shapes: such a ray hits a box inside
+	// them with the ratio of their surface areas. Instances and SphereSets count as primitives.
+	struct BvhReport {
+		// Groups, NoopGroups included.
+		size_t nodes = 0;
+		size_t primitives = 0;
+		size_t max_depth = 0;
+		// Primitives by depth, top level shapes are depth 0.
+		std::vector<size_t> depth_histogram;
+		// Groups by how many of their children are primitives.
+		std::vector<size_t> leaf_sizes;
+		// Primitives outside any group, tested by every ray.
+		size_t top_level = 0;
+		// Top level primitives with at least half the volume of everything, which spatialize leaves at the top.
+		size_t huge = 0;
+		// Shapes without finite bounds, also tested by every ray.
+		size_t unbounded = 0;
+		// Mean over groups with several children: surface area where pairs of children's bounds overlap, over
+		// the group's. 0 for disjoint children, more than 1 when most children overlap most others.
+		double sibling_overlap = 0;
+		// Groups whose children are tested, and exact primitive tests after their bounds are hit.
+		double expected_node_visits = 0;
+		double expected_primitive_tests = 0;
+		// Surface area heuristic cost of the tree, node visits and primitive tests costing one each.
+		double sah_cost = 0;
+
+		explicit BvhReport(const std::vector<std::unique_ptr<Shape>>& shapes);
+		// world's tree, and the unbounded shapes World keeps out of it.
+		explicit BvhReport(const World& world);
+
+		friend std::ostream& operator<<(std::ostream& os, const BvhReport& r);
+
+	private:
+		// Adds group and everything below it. to_world takes its parent's space to the top level's.
+		void visit(const Group& group, const Matrix4& to_world, size_t depth, double root_area, size_t& overlap_groups);
+	};
+
+} // namespace ray
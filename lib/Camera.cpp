@@ -1,7 +1,11 @@
 #include "pch.h"
 #include <chrono>
+#include <thread>
+#include <condition_variable>
+#include <algorithm>
 
 #include "Camera.h"
+#include "Trace.h"
 
 
 using namespace ray;
@@ -42,60 +46,163 @@ Ray Camera::ray(int px, int py) const {
 }
 
 
-void Camera::fill_column(const World* world, std::vector<std::vector<Color>>& pixels) {
-	for (;;) {
-		int localx = x.fetch_add(1);
-		if (localx >= hsize) {
-			return;
+void Camera::fill_column(const World* world, int column, std::vector<std::vector<Color>>& pixels) {
+	// Adjacent pixels in a column are coherent, trace them as packets.
+	for (int y = 0; y < vsize; y += RayPacket::width) {
+		RayPacket packet;
+		for (int i = 0; i < RayPacket::width && y + i < vsize; i++) {
+			packet.add(ray(column, y + i));
 		}
 
-		for (int y = 0; y < vsize; y++) {
-			Ray r = ray(localx, y);
-			Color c = world->color_at(r,8);
-			pixels[localx][y] = c;
+		auto colors = world->color_at(packet, 8);
+		for (int i = 0; i < packet.size(); i++) {
+			pixels[column][y + i] = colors[i];
+		}
+	}
+}
+
+void Camera::cost_column(const World* world, int column, Heat metric, std::vector<std::vector<double>>& cost) {
+	const RayStats& counters = RayStats::local();
+	for (int y = 0; y < vsize; y++) {
+		Ray r = ray(column, y);
+		auto start = std::chrono::steady_clock::now();
+		uint64_t nodes = counters.nodes_visited;
+		uint64_t tests = counters.primitive_tests();
+		world->color_at(r, 8);
+		switch (metric) {
+		case Heat::Nodes:
+			cost[column][y] = static_cast<double>(counters.nodes_visited - nodes);
+			break;
+		case Heat::Tests:
+			cost[column][y] = static_cast<double>(counters.primitive_tests() - tests);
+			break;
+		case Heat::Time:
+		default:
+			cost[column][y] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			break;
 		}
 	}
 }
 
 Canvas Camera::render(const World& world) {
-	auto start = std::chrono::steady_clock::now();
 	Canvas image(hsize, vsize);
+	run([&](int column) { fill_column(&world, column, image.pixels()); });
+	return image;
+}
 
-	x.store(0);
-	std::vector<std::thread> threads;
-	// for (uint32_t i = 0; i < 1; i++) {
-	for (uint32_t i = 0; i < std::thread::hardware_concurrency(); i++) {
-			threads.emplace_back(std::thread([&] { fill_column(&world, image.pixels()); }));
+Canvas Camera::render_heatmap(const World& world, Heat metric) {
+	if (metric != Heat::Time && !stats_enabled) {
+		throw std::runtime_error("node and test heatmaps need a RAY_STATS build");
 	}
 
-	auto last_update = std::chrono::steady_clock::now();
-	while (x < hsize) {
-		auto check = std::chrono::steady_clock::now();
-		std::chrono::duration<double> durdiff = check - last_update;
-		double diff = durdiff.count();
-
-		if (diff > 1) {
-			std::chrono::duration<double> durtot = check - start;
-			double tot = durtot.count();
-			std::cout << floor(100 * x / (double)hsize) << "% (" << floor(tot) << "s)" << std::endl;
-			last_update = check;
+	std::vector<std::vector<double>> cost(hsize, std::vector<double>(vsize, 0.0));
+	run([&](int column) { cost_column(&world, column, metric, cost); });
+
+	std::vector<double> sorted;
+	for (const auto& c : cost) {
+		sorted.insert(sorted.end(), c.begin(), c.end());
+	}
+	size_t top = sorted.size() * 99 / 100;
+	std::nth_element(sorted.begin(), sorted.begin() + top, sorted.end());
+	double scale = sorted[top] > 0 ? 1 / sorted[top] : 0;
+
+	Canvas image(hsize, vsize);
+	auto& pixels = image.pixels();
+	for (int x = 0; x < hsize; x++) {
+		for (int y = 0; y < vsize; y++) {
+			pixels[x][y] = heat_color(cost[x][y] * scale);
 		}
-		else
-		{
-			std::chrono::milliseconds d(10);
-			std::this_thread::sleep_for(d);
+	}
+	return image;
+}
+
+Color Camera::heat_color(double t) {
+	static const Color ramp[] = { Color(0, 0, 0), Color(0, 0, 1), Color(0, 1, 0), Color(1, 1, 0), Color(1, 0, 0) };
+	const int last = sizeof(ramp) / sizeof(ramp[0]) - 1;
+	double at = std::clamp(t, 0.0, 1.0) * last;
+	int i = std::min(static_cast<int>(at), last - 1);
+	double f = at - i;
+	return ramp[i] * (1 - f) + ramp[i + 1] * f;
+}
+
+void Camera::run(const std::function<void(int)>& column) {
+	TraceScope trace("frame");
+	auto start = std::chrono::steady_clock::now();
+
+	x.store(0);
+	stats = RayStats();
+	unsigned count = threads != 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+	// trace row and time each worker ran out of columns, to show its idle time until the frame ends.
+	std::vector<std::pair<int, double>> finished(count);
+	worker_times.assign(count, WorkerTime());
+	// workers still rendering, guarded by stats_lock. The last one to finish wakes this thread.
+	unsigned running = count;
+	std::condition_variable done;
+	auto work = [&](unsigned worker) {
+		WorkerTime& time = worker_times[worker];
+		if (Trace::enabled()) {
+			Trace::name_thread("render " + std::to_string(worker));
+		}
+		// start from zero in case this thread counted something before.
+		RayStats::take();
+		for (int localx = x.fetch_add(1); localx < hsize; localx = x.fetch_add(1)) {
+			TraceScope trace("column");
+			auto begin = std::chrono::steady_clock::now();
+			column(localx);
+			time.busy += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+			time.columns++;
+		}
+		if (Trace::enabled()) {
+			finished[worker] = { Trace::thread_id(), Trace::now() };
+		}
+		RayStats mine = RayStats::take();
+		std::lock_guard<std::mutex> lock(stats_lock);
+		stats += mine;
+		if (--running == 0) {
+			done.notify_one();
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (uint32_t i = 0; i < count; i++) {
+			workers.emplace_back(std::thread(work, i));
+	}
+
+	// wakes as soon as the frame is done, so small frames aren't timed to a polling period. Progress every second.
+	{
+		std::unique_lock<std::mutex> lock(stats_lock);
+		while (!done.wait_for(lock, std::chrono::seconds(1), [&] { return running == 0; })) {
+			if (verbose) {
+				std::chrono::duration<double> durtot = std::chrono::steady_clock::now() - start;
+				double tot = durtot.count();
+				std::cout << floor(100 * std::min<int>(x, hsize) / (double)hsize) << "% (" << floor(tot) << "s)" << std::endl;
+			}
 		}
 	}
 
-	for (auto& t : threads) {
+	for (auto& t : workers) {
 		t.join();
 	}
+	if (Trace::enabled()) {
+		double end = Trace::now();
+		for (const auto& [tid, at] : finished) {
+			if (tid != 0) {
+				Trace::complete("idle", tid, at, end);
+			}
+		}
+	}
 
 	auto end = std::chrono::steady_clock::now();
 	std::chrono::duration<double> durdiff = end - start;
 	double diff = durdiff.count();
+	for (auto& time : worker_times) {
+		time.idle = std::max(0.0, diff - time.busy);
+	}
 	double megapixels_per_sec = hsize * vsize / diff / 1000000;
-	std::cout << std::setw(9) << hsize << "x" << vsize << " render time: " << diff << "s " << megapixels_per_sec << " megapixels/sec" << std::endl;
-
-	return image;
+	if (verbose) {
+		std::cout << std::setw(9) << hsize << "x" << vsize << " render time: " << diff << "s " << megapixels_per_sec << " megapixels/sec" << std::endl;
+		if (stats_enabled) {
+			std::cout << stats;
+		}
+	}
 }
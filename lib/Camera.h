@@ -4,19 +4,50 @@
 #include <iostream>
 #include <iomanip>
 #include <atomic>
+#include <mutex>
+#include <functional>
+#include <stdexcept>
 #include "Matrix.h"
 #include "World.h"
 #include "Canvas.h"
+#include "Stats.h"
 
 namespace ray {
 
+// Per pixel cost shown by Camera::render_heatmap.
+enum class Heat {
+	// wall clock time to trace and shade the pixel.
+	Time,
+	// group and SphereSet nodes visited, needs RAY_STATS.
+	Nodes,
+	// exact primitive tests, needs RAY_STATS.
+	Tests,
+};
+
+// Where one render thread's time went in the last frame.
+struct WorkerTime {
+	// Seconds tracing its columns.
+	double busy = 0;
+	// The rest of the frame: starting, waiting for the next column and done before the other threads.
+	double idle = 0;
+	int columns = 0;
+};
+
 class Camera
 {
 public:
 	Camera(int h, int v, double field);
 	Ray ray(int px, int py) const;
-	void fill_column(const World* world, std::vector<std::vector<Color>>& pixels);
+	void fill_column(const World* world, int column, std::vector<std::vector<Color>>& pixels);
+	// Cost of every pixel in column, traced one ray at a time so each pixel is measured on its own.
+	void cost_column(const World* world, int column, Heat metric, std::vector<std::vector<double>>& cost);
 	Canvas render(const World& world);
+	// Renders cost instead of color: black for free pixels through blue, green and yellow to red for the
+	// most expensive. The ramp tops out at the 99th percentile, so a few outliers don't wash out the rest.
+	Canvas render_heatmap(const World& world, Heat metric);
+
+	// Maps t in [0, 1] onto the heatmap ramp.
+	static Color heat_color(double t);
 
 public:
 	int hsize;
@@ -24,10 +55,22 @@ public:
 	double fov;
 	double pixel_size;
 	Matrix4 transform;
+	// Render threads, 0 for one per hardware thread.
+	unsigned threads = 0;
+	// Print progress and the final timing line to std::cout.
+	bool verbose = true;
+	// Counters of the last render, summed over its threads. All zero unless built with RAY_STATS.
+	RayStats stats;
+	// Time of each render thread in the last render, to see how well the columns spread over threads.
+	std::vector<WorkerTime> worker_times;
 
 private:
+	// Calls column for every column from the render threads, then prints the timing line.
+	void run(const std::function<void(int)>& column);
+
 	// shared thread state
 	std::atomic_int x;
+	std::mutex stats_lock;
 
 	double half_width;
 	double half_height;
@@ -1,10 +1,14 @@
 #include "pch.h"
 #include "Canvas.h"
+#include "Trace.h"
 #include <array>
 #include <algorithm>
 #include <string>
+#include <istream>
+#include <stdexcept>
 namespace ray {
 	void Canvas::write_ppm(std::ostream& s) {
+		TraceScope trace("write_ppm");
 		// color range
 		int range = 255;
 		// PPM header
@@ -42,4 +46,50 @@ namespace ray {
 		}
 	}
 
+	namespace {
+		// Next whitespace separated token, skipping # comments. Empty at the end of the input.
+		std::string ppm_token(std::istream& s) {
+			std::string token;
+			while (s >> token) {
+				if (token[0] != '#') {
+					return token;
+				}
+				std::string comment;
+				std::getline(s, comment);
+			}
+			return "";
+		}
+
+		int ppm_int(std::istream& s) {
+			std::string token = ppm_token(s);
+			if (token.empty() || token.find_first_not_of("0123456789") != std::string::npos) {
+				throw std::runtime_error("bad ppm value '" + token + "'");
+			}
+			return std::stoi(token);
+		}
+	}
+
+	Canvas Canvas::read_ppm(std::istream& s) {
+		if (ppm_token(s) != "P3") {
+			throw std::runtime_error("not a plain (P3) ppm");
+		}
+		int width = ppm_int(s);
+		int height = ppm_int(s);
+		double range = ppm_int(s);
+		if (width == 0 || height == 0 || range == 0) {
+			throw std::runtime_error("empty ppm");
+		}
+
+		Canvas c(width, height);
+		for (int y = 0; y < height; y++) {
+			for (int x = 0; x < width; x++) {
+				double r = ppm_int(s) / range;
+				double g = ppm_int(s) / range;
+				double b = ppm_int(s) / range;
+				c.grid[x][y] = Color(r, g, b);
+			}
+		}
+		return c;
+	}
+
 }
@@ -20,6 +20,9 @@ namespace ray {
 			return grid;
 		}
 		void write_ppm(std::ostream& s);
+		// Reads a plain (P3) PPM, as written by write_ppm or other tools. Comments are skipped and values are scaled
+		// by the maximum in the header.
+		static Canvas read_ppm(std::istream& s);
 
 	private:
 		std::vector<std::vector<Color>> grid;
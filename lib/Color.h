@@ -11,6 +11,8 @@ namespace ray {
 		double g = 0.0f;
 		double b = 0.0f;
 
+		// black.
+		Color() = default;
 		Color(double inr, double ing, double inb) : r(inr), g(ing), b(inb) {}
 
 		friend std::ostream& operator<<(std::ostream& os, const Color& c) {
@@ -5,29 +5,63 @@
 #include "Shape.h"
 using namespace ray;
 
-const Intersection* IntersectionList::hit() {
-	for (const auto& i : intersections) {
-		if (i.t >= 0) {
-			return &i;
-		}
+namespace {
+	std::vector<std::vector<Intersection>>& spare_buffers() {
+		thread_local std::vector<std::vector<Intersection>> spares;
+		return spares;
 	}
+}
 
-	return nullptr;
+std::vector<Intersection> IntersectionList::take_buffer() {
+	auto& spares = spare_buffers();
+	if (spares.empty()) {
+		count(&RayStats::list_heap_allocations);
+		std::vector<Intersection> buffer;
+		buffer.reserve(16);
+		return buffer;
+	}
+
+	std::vector<Intersection> buffer = std::move(spares.back());
+	spares.pop_back();
+	return buffer;
 }
 
-const Intersection* IntersectionList::hit_ignoretransparent() {
-	for (const auto& i : intersections) {
-		if (i.object->material.transparency > 0.9) {
-			// ignore very transparent things, like water..
-			continue;
+void IntersectionList::give_back(std::vector<Intersection>&& buffer) {
+	buffer.clear();
+	spare_buffers().push_back(std::move(buffer));
+}
+
+void MediumStack::cross(const Shape* object, const Instance* instance, uint32_t index, double refractive_index) {
+	for (size_t i = _size; i-- > 0;) {
+		const Medium& m = _media[i];
+		if (m.object == object && m.index == index && m.instance == instance) {
+			std::copy(_media.begin() + i + 1, _media.begin() + _size, _media.begin() + i);
+			_size--;
+			return;
 		}
+	}
+
+	if (_size == capacity) {
+		std::copy(_media.begin() + 1, _media.end(), _media.begin());
+		_size--;
+	}
+	_media[_size++] = { object, instance, index, refractive_index };
+}
 
-		if (i.t >= 0) {
-			return &i;
+void MediumStack::cross(const Intersection& hit, const Instance* instance) {
+	cross(hit.object, instance, hit.index, hit.material(instance).refractive_index);
+}
+
+// Linear scan for the smallest t, ties go to the earliest in the list, so sorted lists give their first positive hit.
+const Intersection* IntersectionList::hit() {
+	const Intersection* best = nullptr;
+	for (const auto& i : intersections) {
+		if (i.t >= 0 && (best == nullptr || i.t < best->t)) {
+			best = &i;
 		}
 	}
 
-	return nullptr;
+	return best;
 }
 
 void IntersectionList::sort() {
@@ -39,13 +73,22 @@ void IntersectionList::sort() {
 	std::sort(intersections.begin(), intersections.end(), customLess);
 }
 
-IntersectionInfo Intersection::infox(const Ray& ray) const {
+IntersectionInfo Intersection::infox(const Ray& ray, const Instance* instance) const {
 	IntersectionInfo info;
 	info.t = t;
 	info.object = object;
+	info.instance = instance;
+	info.material = &material(instance);
+	info.index = index;
 	info.point = ray.position(info.t);
 	info.eye = -ray.direction();
-	info.normal = info.object->normal_at(info.point, *this);
+	if (instance != nullptr) {
+		// parent chains of instanced meshes end at the mesh, the instance supplies the rest.
+		info.normal = instance->normal_to_world(object->normal_at(instance->world_to_object(info.point), *this));
+	}
+	else {
+		info.normal = object->normal_at(info.point, *this);
+	}
 	if (info.normal.dot(info.eye) < 0) {
 		info.inside = true;
 		info.normal = -info.normal;
@@ -57,11 +100,11 @@ IntersectionInfo Intersection::infox(const Ray& ray) const {
 }
 
 IntersectionInfo IntersectionList::info(const Ray& ray, const Intersection* hit) const {
-	IntersectionInfo info = hit->infox(ray);
+	IntersectionInfo info = hit->infox(ray, instance(*hit));
 
 	char buffer[64];
 	std::pmr::monotonic_buffer_resource pool{ std::data(buffer), std::size(buffer) };
-	std::pmr::vector<const Shape*> containers{ &pool };
+	std::pmr::vector<const Intersection*> containers{ &pool };
 
 	for (const auto& i : intersections) {
 		if (&i == hit) {
@@ -70,18 +113,23 @@ IntersectionInfo IntersectionList::info(const Ray& ray, const Intersection* hit)
 			}
 			else
 			{
-				const Shape* last = *containers.rbegin();
-				info.n1 = last->material.refractive_index;
+				const Intersection* last = *containers.rbegin();
+				info.n1 = last->material(instance(*last)).refractive_index;
+			}
+
+			for (const Intersection* c : containers) {
+				info.media.cross(*c, instance(*c));
 			}
 		}
 
-		auto it = std::find(containers.begin(), containers.end(), i.object);
+		// instances of one mesh share objects, so match on object and instance.
+		auto it = std::find_if(containers.begin(), containers.end(), [&](const Intersection* c) { return c->same_surface(i); });
 		if (it != containers.end()) {
 			containers.erase(it);
 		}
 		else
 		{
-			containers.emplace_back(i.object);
+			containers.emplace_back(&i);
 		}
 
 		if (&i == hit) {
@@ -90,8 +138,8 @@ IntersectionInfo IntersectionList::info(const Ray& ray, const Intersection* hit)
 			}
 			else
 			{
-				const Shape* last = *containers.rbegin();
-				info.n2 = last->material.refractive_index;
+				const Intersection* last = *containers.rbegin();
+				info.n2 = last->material(instance(*last)).refractive_index;
 			}
 
 			break;
@@ -100,3 +148,14 @@ IntersectionInfo IntersectionList::info(const Ray& ray, const Intersection* hit)
 
 	return info;
 }
+
+IntersectionInfo IntersectionList::info(const Ray& ray, const Intersection* hit, const MediumStack& media) const {
+	IntersectionInfo info = hit->infox(ray, instance(*hit));
+	info.media = media;
+	info.n1 = media.refractive_index();
+
+	MediumStack past = media;
+	past.cross(*hit, info.instance);
+	info.n2 = past.refractive_index();
+	return info;
+}
@@ -1,9 +1,47 @@
 #pragma once
 #include "Shape.h"
 #include "Tuple.h"
+#include "Stats.h"
 #include <algorithm>
+#include <array>
+#include <limits>
 
 namespace ray {
+	class Intersection;
+
+	// Surfaces a ray is inside of, innermost last. Carried along from ray to ray (refracted rays cross the surface,
+	// others stay put), so the refractive indices at a hit come from the hit alone instead of every hit before it.
+	class MediumStack {
+	public:
+		// Nesting deeper than this forgets the outermost surface.
+		static constexpr size_t capacity = 8;
+
+		// Refractive index of the innermost surface, 1 (ie. air) outside everything.
+		double refractive_index() const {
+			return _size == 0 ? 1 : _media[_size - 1].refractive_index;
+		}
+
+		size_t size() const {
+			return _size;
+		}
+
+		// Leaves the surface if we're inside it, enters it otherwise.
+		void cross(const Shape* object, const Instance* instance, uint32_t index, double refractive_index);
+		// instance: the one hit is in, see IntersectionList::instance.
+		void cross(const Intersection& hit, const Instance* instance = nullptr);
+
+	private:
+		struct Medium {
+			const Shape* object;
+			const Instance* instance;
+			uint32_t index;
+			double refractive_index;
+		};
+
+		std::array<Medium, capacity> _media;
+		size_t _size = 0;
+	};
+
 	class IntersectionInfo {
 	public:
 		double t = 0;
@@ -12,6 +50,14 @@ namespace ray {
 		// refractive index to
 		double n2 = 1;
 		const Shape* object = nullptr;
+		// set when object is part of an instanced mesh.
+		const Instance* instance = nullptr;
+		// object's material, or instance's when overridden.
+		const Material* material = nullptr;
+		// Intersection::index of the hit.
+		uint32_t index = 0;
+		// media the ray travels in, before crossing the hit surface.
+		MediumStack media;
 		Point3 point;
 		Point3 over_point;
 		Point3 under_point;
@@ -41,37 +87,133 @@ namespace ray {
 	{
 	public:
 		const Shape* object;
+
+		// Stays double: float t puts over_point/under_point (RAY_EPSILON off the surface) on the wrong side at scene distances.
 		double t;
 
-		// smooth triangle intersection specific.
-		// todo: could this go somewhere that doesn't penalize non-smoothtriangles?
-		double u = 0, v =0;
+		// Primitive within object, for shapes holding many (eg. SphereSet).
+		uint32_t index = 0;
+
+		// Triangle barycentrics, only read by smooth triangle normals. Float keeps the record at 32 bytes.
+		float u = 0, v = 0;
 
-		Intersection(double time, const Shape* shape) : t(time), object(shape) {}
-		Intersection(double time, const Shape* shape, double inu, double inv) : t(time), object(shape), u(inu), v(inv) {}
-		IntersectionInfo infox(const Ray& ray) const;
+		// For hits inside an instanced mesh, 1 + which of the holding list's instances, see IntersectionList::instance.
+		// 0 for shapes placed directly.
+		uint32_t instance_slot = 0;
+
+		Intersection(double time, const Shape* shape) : object(shape), t(time) {}
+		Intersection(double time, const Shape* shape, double inu, double inv) : object(shape), t(time), u(static_cast<float>(inu)), v(static_cast<float>(inv)) {}
+		// instance: the one whose mesh holds object, nullptr for shapes placed directly.
+		IntersectionInfo infox(const Ray& ray, const Instance* instance = nullptr) const;
+
+		const Material& material(const Instance* instance = nullptr) const {
+			if (instance != nullptr && instance->override_material) {
+				return instance->material;
+			}
+			return object->material;
+		}
+
+		// Same surface, ie. same shape (and primitive) in the same instance. For hits of the same list.
+		bool same_surface(const Intersection& rhs) const {
+			return object == rhs.object && index == rhs.index && instance_slot == rhs.instance_slot;
+		}
 	};
 
 	class IntersectionList
 	{
 	public:
-		IntersectionList() {
-			// take all of buffer in a single allocation.
-			size_t newsize = sizeof(buffer) / sizeof(Intersection);
-			intersections.reserve(newsize);
+		IntersectionList() : intersections(take_buffer()) {}
+		// Hits of a kind of ray, only shapes visible to that kind are tested.
+		explicit IntersectionList(RayKind kind) : intersections(take_buffer()), _kind(kind) {}
+
+		// Shadow query towards a light distance away: hits in [0, distance) aren't stored, their transparency is multiplied
+		// into transmittance() instead. Traversal stops early once done().
+		static IntersectionList shadow(double distance) {
+			return IntersectionList(distance);
 		}
 
+		// Makes an empty list a closest hit query: only the nearest hit at t >= 0 is kept, and traversal skips what
+		// starts past() it. For shading, which needs just the hit.
+		void keep_closest() {
+			_closest = true;
+		}
+
+		~IntersectionList() {
+			if (!_shadow) {
+				give_back(std::move(intersections));
+			}
+		}
+		IntersectionList(const IntersectionList&) = delete;
+		IntersectionList& operator=(const IntersectionList&) = delete;
+
 		// Returns the smallest positive hit. As a raw pointer, straight into list.
-		// Returns nullptr on miss.
+		// Returns nullptr on miss. The list needn't be sorted.
 		const Intersection* hit();
-		const Intersection* hit_ignoretransparent();
 		void sort();
 		void append(Intersection&& intersection) {
+			intersection.instance_slot = _instance_slot;
+			if (_shadow) {
+				occlude(intersection);
+				return;
+			}
+			if (_closest) {
+				keep_if_closer(intersection);
+				return;
+			}
+			if (stats_enabled && intersections.size() == intersections.capacity()) {
+				count(&RayStats::list_heap_allocations);
+			}
 			intersections.push_back(std::move(intersection));
 		}
 
-		// Return info at hit. List is needed for refractions.
+		RayKind kind() const {
+			return _kind;
+		}
+
+		// Hits appended from now on are inside instance's mesh, until set back to nullptr.
+		void set_instance(const Instance* instance) {
+			if (instance == nullptr) {
+				_instance_slot = 0;
+				return;
+			}
+			// one slot per instance, so same_surface can compare slots.
+			auto it = std::find(_instances.begin(), _instances.end(), instance);
+			if (it == _instances.end()) {
+				it = _instances.insert(it, instance);
+			}
+			_instance_slot = static_cast<uint32_t>(it - _instances.begin()) + 1;
+		}
+
+		// Instance whose mesh holds hit, a hit of this list. nullptr for shapes placed directly.
+		const Instance* instance(const Intersection& hit) const {
+			return hit.instance_slot == 0 ? nullptr : _instances[hit.instance_slot - 1];
+		}
+
+		// Shadow queries: fraction of light getting through the hits so far.
+		double transmittance() const {
+			return _transmittance;
+		}
+
+		// True once a shadow query found too little light getting through to see, traversal can stop.
+		bool done() const {
+			return _transmittance < min_transmittance;
+		}
+
+		// True when nothing from t on can change the query: past the nearest hit so far of a closest hit query, or past
+		// the light of a shadow query. Traversal skips boxes entered past() it. t is the same in every space a ray is
+		// moved to, as directions aren't renormalized. Allows for float box tests being off by a few ulps of t.
+		bool past(double t) const {
+			return t > _cutoff;
+		}
+
+		// Below what an 8 bit color channel can show.
+		static constexpr double min_transmittance = 1.0 / 512;
+
+		// Return info at hit, with refractive indices worked out from the (sorted) hits before it.
+		// For rays that don't start outside everything, or when every hit of the ray is at hand.
 		IntersectionInfo info(const Ray& ray, const Intersection* hit) const;
+		// Return info at hit of a ray travelling in media. Only needs hit, so the list may hold just some of the hits.
+		IntersectionInfo info(const Ray& ray, const Intersection* hit, const MediumStack& media) const;
 
 		size_t size() {
 			return intersections.size();
@@ -86,11 +228,48 @@ namespace ray {
 		}
 
 	private:
-		// avoid heap allocations for small vectors. 
-		// 128 was found by trial and error in profiler for chapter 7 scene.
-		char buffer[128];
-		std::pmr::monotonic_buffer_resource pool{ std::data(buffer), std::size(buffer) };
-		std::pmr::vector<Intersection> intersections{ &pool };
+		std::vector<Intersection> intersections;
+		// Instances hits are in, kept here to keep Intersection small. Slot i + 1 is _instances[i].
+		std::vector<const Instance*> _instances;
+		uint32_t _instance_slot = 0;
+		RayKind _kind = CameraRay;
+		bool _shadow = false;
+		bool _closest = false;
+		double _distance = 0;
+		double _transmittance = 1;
+		// see past().
+		double _cutoff = std::numeric_limits<double>::infinity();
+
+		static constexpr double cutoff_slack = 1e-5;
+
+		IntersectionList(double distance) : _kind(ShadowRay), _shadow(true), _distance(distance),
+			_cutoff(distance + distance * cutoff_slack) {}
+
+		// Ties keep the earlier hit, as hit() does.
+		void keep_if_closer(const Intersection& i) {
+			if (i.t < 0 || (!intersections.empty() && i.t >= intersections[0].t)) {
+				return;
+			}
+			if (intersections.empty()) {
+				intersections.push_back(i);
+			}
+			else {
+				intersections[0] = i;
+			}
+			_cutoff = i.t + i.t * cutoff_slack;
+		}
+
+		void occlude(const Intersection& i) {
+			if (i.t >= 0 && i.t < _distance) {
+				_transmittance *= i.material(instance(i)).transparency;
+			}
+		}
+
+		// Lists borrow their vector from a per thread pool of spares, and return it (capacity and all) when destroyed.
+		// Lists nest (shadow and reflection rays are traced while the camera ray's list is alive), so the pool holds
+		// one spare per nesting level. After warm up tracing allocates nothing, however many hits a ray collects.
+		static std::vector<Intersection> take_buffer();
+		static void give_back(std::vector<Intersection>&& buffer);
 	};
 
 }
@@ -1,26 +1,50 @@
 #pragma once
 #include "Tuple.h"
 #include "Color.h"
+#include <limits>
+#include <algorithm>
 namespace ray {
 class PointLight
 {
 public:
 	PointLight() = default;
 	PointLight(const Point3& pos, const Color& c) : position(pos), intensity(c) {}
+	PointLight(const Point3& pos, const Color& c, double r) : position(pos), intensity(c), range(r) {}
 
 	friend std::ostream& operator<<(std::ostream& os, const PointLight& rhs) {
 		return os << "PointLight(" << rhs.position << ", " << rhs.intensity << ")";
 	}
 
 	bool operator==(const PointLight& rhs) const {
-		return position == rhs.position && intensity == rhs.intensity;
+		return position == rhs.position && intensity == rhs.intensity && range == rhs.range;
 	}
 	bool operator!=(const PointLight& rhs) const {
 		return !operator==(rhs);
 	}
 
+	// Fraction of intensity left distance away: 1 up close, fading smoothly to 0 at range.
+	double falloff(double distance) const {
+		if (range == std::numeric_limits<double>::infinity()) {
+			return 1;
+		}
+		if (distance >= range) {
+			return 0;
+		}
+		double x = distance / range;
+		double window = 1 - x * x * x * x;
+		return window * window;
+	}
+
+	// Brightest channel, how much the light can add to any surface.
+	double power() const {
+		return std::max(intensity.r, std::max(intensity.g, intensity.b));
+	}
+
 	Point3 position;
 	Color intensity;
+	// Distance the light reaches. The book's lights reach everywhere, with a finite range the world skips lights too far
+	// away to matter, which keeps shadow rays local in scenes with many small lights.
+	double range = std::numeric_limits<double>::infinity();
 };
 } // namespace ray
 
@@ -19,7 +19,7 @@ namespace ray {
 		Material() : pattern(std::make_unique<Solid>(Color::white())) {}
 
 		friend std::ostream& operator<<(std::ostream& os, const Material& m) {
-			return os << "Material(" << m.pattern << ", " << m.ambient << ", " << m.diffuse << ", " << m.specular << ", " << m.shininess << ")";
+			return os << "Material(" << m.pattern.get() << ", " << m.ambient << ", " << m.diffuse << ", " << m.specular << ", " << m.shininess << ")";
 		}
 
 		bool operator==(const Material& rhs) const {
@@ -56,14 +56,20 @@ namespace ray {
 			duplicate(other);
 		}
 
-		Color lighting(const PointLight& light, const Shape& shape, const Point3& point, const Vec3& eye, const Vec3& normal, bool in_shadow) const {
-			Color baseColor = pattern->pattern_at_shape(shape, point);
+		// visible: how much of the light reaches point, 0 in shadow, 1 in full light, in between eg. through glass.
+		// Above 1 scales the light up, for a sampled light standing in for the ones that weren't.
+		Color lighting(const PointLight& light, const Shape& shape, const Point3& point, const Vec3& eye, const Vec3& normal, double visible) const {
+			return lighting(light, pattern->pattern_at_shape(shape, point), point, eye, normal, visible);
+		}
+
+		// As above, with the pattern already looked up. (eg. instanced shapes, where point isn't in shape's world.)
+		Color lighting(const PointLight& light, const Color& baseColor, const Point3& point, const Vec3& eye, const Vec3& normal, double visible) const {
 			Color effcolor = baseColor * light.intensity;
 			Color ambcolor = effcolor * ambient;
 			Color diffcolor = Color::black();
 			Color speccolor = Color::black();
 
-			if (!in_shadow) {
+			if (visible > 0) {
 				Vec3 lightv = (light.position - point).norm();
 				double dotlight = lightv.dot(normal);
 				if (dotlight > 0) {
@@ -77,6 +83,11 @@ namespace ray {
 				}
 			}
 
+			if (visible != 1) {
+				diffcolor = diffcolor * visible;
+				speccolor = speccolor * visible;
+			}
+
 			return ambcolor + diffcolor + speccolor;
 		}
 
@@ -13,7 +13,7 @@ namespace ray {
 		Matrix2() {
 			m00 = m11 = 1;
 		}
-		Matrix2(std::array<double, 4>& i) {
+		Matrix2(const std::array<double, 4>& i) {
 			m00 = i[0];
 			m01 = i[1];
 
@@ -53,7 +53,7 @@ namespace ray {
 		Matrix3() {
 			m00 = m11 = m22 = 1;
 		}
-		Matrix3(std::array<double, 9>& i) {
+		Matrix3(const std::array<double, 9>& i) {
 			m00 = i[0];
 			m01 = i[1];
 			m02 = i[2];
@@ -171,7 +171,7 @@ namespace ray {
 			m[0] = m[5] = m[10] = m[15] = 1;
 			update_inverse_cache();
 		}
-		Matrix4(std::array<double, 16>& a) : m(a) {
+		Matrix4(const std::array<double, 16>& a) : m(a) {
 			update_inverse_cache();
 		}
 
@@ -416,6 +416,11 @@ namespace ray {
 			return Matrix4();
 		}
 
+		// Exactly identity, unlike operator== which allows for epsilon.
+		bool is_identity() const {
+			return m == identity().m;
+		}
+
 		static Matrix4 translate(double x, double y, double z) {
 			Matrix4 m;
 			m.m[3] = x;
@@ -1,5 +1,6 @@
 #pragma once
 #include <cmath>
+#include <memory>
 
 #include "Color.h"
 #include "Matrix.h"
@@ -8,9 +8,13 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
+#include <mutex>
+#include <random>
 
 // warning C4244: '=': conversion from 'double' to 'float', possible loss of data
+#ifdef _MSC_VER
 #pragma warning(disable:4244)
+#endif
 
 #define B 0x100
 #define BM 0xff
@@ -23,7 +27,8 @@ static int p[B + B + 2];
 static float g3[B + B + 2][3];
 static float g2[B + B + 2][2];
 static float g1[B + B + 2];
-static int start = 1;
+// init runs once, on first use from whichever render thread gets there first.
+static std::once_flag started;
 
 static void init(void);
 
@@ -44,10 +49,7 @@ double noise1(double arg)
 	float rx0, rx1, sx, t, u, v, vec[1];
 
 	vec[0] = arg;
-	if (start) {
-		start = 0;
-		init();
-	}
+	std::call_once(started, init);
 
 	setup(0, bx0, bx1, rx0, rx1);
 
@@ -65,10 +67,7 @@ float noise2(float vec[2])
 	float rx0, rx1, ry0, ry1, * q, sx, sy, a, b, t, u, v;
 	int i, j;
 
-	if (start) {
-		start = 0;
-		init();
-	}
+	std::call_once(started, init);
 
 	setup(0, bx0, bx1, rx0, rx1);
 	setup(1, by0, by1, ry0, ry1);
@@ -103,10 +102,7 @@ float perlin_noise3(float vec[3])
 	float rx0, rx1, ry0, ry1, rz0, rz1, * q, sy, sz, a, b, c, d, t, u, v;
 	int i, j;
 
-	if (start) {
-		start = 0;
-		init();
-	}
+	std::call_once(started, init);
 
 	setup(0, bx0, bx1, rx0, rx1);
 	setup(1, by0, by1, ry0, ry1);
@@ -168,29 +164,35 @@ static void normalize3(float v[3])
 	v[2] = v[2] / s;
 }
 
+// Fixed seed, so renders repeat exactly. Its own generator, so the rand() sequence scenes are built from doesn't
+// depend on when noise is first used.
+static int random_int()
+{
+	static std::minstd_rand generator(1);
+	return static_cast<int>(generator());
+}
+
 static void init(void)
 {
 	int i, j, k;
 
-	srand((unsigned)time(NULL));
-
 	for (i = 0; i < B; i++) {
 		p[i] = i;
 
-		g1[i] = (float)((rand() % (B + B)) - B) / B;
+		g1[i] = (float)((random_int() % (B + B)) - B) / B;
 
 		for (j = 0; j < 2; j++)
-			g2[i][j] = (float)((rand() % (B + B)) - B) / B;
+			g2[i][j] = (float)((random_int() % (B + B)) - B) / B;
 		normalize2(g2[i]);
 
 		for (j = 0; j < 3; j++)
-			g3[i][j] = (float)((rand() % (B + B)) - B) / B;
+			g3[i][j] = (float)((random_int() % (B + B)) - B) / B;
 		normalize3(g3[i]);
 	}
 
 	while (--i) {
 		k = p[i];
-		p[i] = p[j = rand() % B];
+		p[i] = p[j = random_int() % B];
 		p[j] = k;
 	}
 
@@ -1,6 +1,7 @@
 // Based heavily on the PLY test example included with the Stanford PLY library.
 #include "pch.h"
 #include "PlyLoader.h"
+#include "Trace.h"
 #include "ply.h"
 
 using namespace ray;
@@ -28,6 +29,7 @@ PlyProperty face_props[] = { /* list of property information for a vertex */
 };
 
 PlyLoader::PlyLoader(const std::string& filename) {
+    TraceScope trace("PlyLoader");
     int i, j, k;
     PlyFile* ply;
     int nelems;
@@ -17,6 +17,16 @@ namespace ray {
 			return mega;
 		}
 
+		// As above, with a hierarchy built over the faces. Scans run to millions of faces, see BuildMode::Lbvh.
+		std::unique_ptr<Group> get_mega_group(BuildMode mode) {
+			auto mega = std::make_unique<Group>();
+			for (auto& s : NoopGroup::build(std::move(shape), mode)) {
+				mega->add(std::move(s));
+			}
+			shape.clear();
+			return mega;
+		}
+
 	private:
 
 		std::vector<std::unique_ptr<Shape>> shape;
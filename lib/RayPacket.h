@@ -0,0 +1,110 @@
+#pragma once
+#include <array>
+#include "Ray.h"
+#include "Matrix.h"
+#include "Simd.h"
+
+namespace ray {
+
+	// Up to 4 coherent rays (eg. adjacent camera pixels) that traverse the scene together.
+	// Node bounds are fetched and tested once for the whole packet instead of once per ray.
+	class RayPacket
+	{
+	public:
+		static constexpr int width = 4;
+
+		std::array<Ray, width> rays;
+		// bit i is set when rays[i] holds a ray.
+		int active = 0;
+
+		RayPacket() = default;
+
+		// Adds r to the next free lane.
+		void add(const Ray& r) {
+			int lane = size();
+			assert(lane < width);
+			rays[lane] = r;
+			set_lane(lane);
+			active |= 1 << lane;
+		}
+
+		int size() const {
+			int count = 0;
+			for (int m = active; m != 0; m >>= 1) {
+				count += m & 1;
+			}
+			return count;
+		}
+
+		// Returns packet with every ray moved into the space of m (ie. m.inverse() * ray).
+		RayPacket inverse_multiply(const Matrix4& m) const {
+			RayPacket local;
+			for (int i = 0; i < width; i++) {
+				if (active & (1 << i)) {
+					local.rays[i] = m.inverse_multiply(rays[i]);
+					local.set_lane(i);
+				}
+			}
+			local.active = active;
+			return local;
+		}
+
+		// Returns the subset of mask whose rays hit b. tnear, when given, receives each lane's entry distance.
+		int hit_mask(const FloatBounds& b, int mask, float* tnear = nullptr) const {
+			float4 t;
+			int hit = slab4(
+				load4(ox), load4(oy), load4(oz),
+				load4(ix), load4(iy), load4(iz),
+				load4(px), load4(py), load4(pz),
+				splat(b.min[0]), splat(b.min[1]), splat(b.min[2]),
+				splat(b.max[0]), splat(b.max[1]), splat(b.max[2]),
+				t);
+			if (tnear != nullptr) {
+				store4(tnear, t);
+			}
+			return hit & mask;
+		}
+
+		// Sets hits[i] to the subset of mask whose rays may hit triangle i of pack (0 for inactive lanes),
+		// see TrianglePack::hit_mask.
+		void hit_masks(const TrianglePack& pack, int mask, int* hits) const {
+			float4 x = load4(ox), y = load4(oy), z = load4(oz);
+			float4 u = load4(dx), v = load4(dy), w = load4(dz);
+			for (int i = 0; i < simd_width; i++) {
+				hits[i] = (pack.active & (1 << i)) ? pack.rays_mask(i, x, y, z, u, v, w) & mask : 0;
+			}
+		}
+
+	private:
+		// SoA float copy of origin, direction, inverse direction and origin_pad, one lane per ray.
+		alignas(16) float ox[width] = {};
+		alignas(16) float oy[width] = {};
+		alignas(16) float oz[width] = {};
+		alignas(16) float dx[width] = {};
+		alignas(16) float dy[width] = {};
+		alignas(16) float dz[width] = {};
+		alignas(16) float ix[width] = {};
+		alignas(16) float iy[width] = {};
+		alignas(16) float iz[width] = {};
+		alignas(16) float px[width] = {};
+		alignas(16) float py[width] = {};
+		alignas(16) float pz[width] = {};
+
+		void set_lane(int lane) {
+			const Ray& r = rays[lane];
+			ox[lane] = static_cast<float>(r.origin.x);
+			oy[lane] = static_cast<float>(r.origin.y);
+			oz[lane] = static_cast<float>(r.origin.z);
+			dx[lane] = static_cast<float>(r.direction().x);
+			dy[lane] = static_cast<float>(r.direction().y);
+			dz[lane] = static_cast<float>(r.direction().z);
+			ix[lane] = float_inv(r.invdirection().x);
+			iy[lane] = float_inv(r.invdirection().y);
+			iz[lane] = float_inv(r.invdirection().z);
+			px[lane] = origin_pad(r.origin.x);
+			py[lane] = origin_pad(r.origin.y);
+			pz[lane] = origin_pad(r.origin.z);
+		}
+	};
+
+} // namespace ray
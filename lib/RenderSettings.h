@@ -0,0 +1,34 @@
+#pragma once
+
+namespace ray {
+
+	// How the hierarchy over a list of shapes is built.
+	enum class BuildMode {
+		// Octant buckets (NoopGroup::spatialize). Tightest trees, slowest build.
+		Bucket,
+		// Morton order linear BVH (NoopGroup::lbvh). Near linear build, looser trees.
+		Lbvh,
+		// Binned surface area heuristic (NoopGroup::sah). Tight trees, top levels built in parallel.
+		Sah,
+	};
+
+	// Knobs trading render quality for speed.
+	struct RenderSettings {
+		BuildMode build = BuildMode::Bucket;
+		// World::update_transform rebuilds a subtree once refits grow its surface area past this many times its built area.
+		double rebuild_ratio = 2;
+		// Lights picked per shading point, by their unshadowed contribution, each weighted to stand in for the rest.
+		// Caps shadow rays per hit in scenes with many lights, at the cost of noise. 0 shades with every light.
+		int light_samples = 0;
+		// Lights adding less than this (unshadowed, brightest channel) to a point skip their shadow ray.
+		double light_cutoff = 1.0 / 512;
+
+		// Fast startup over fast traversal, for quick looks at big scenes.
+		static RenderSettings preview() {
+			RenderSettings settings;
+			settings.build = BuildMode::Lbvh;
+			return settings;
+		}
+	};
+
+} // namespace ray
@@ -1,9 +1,12 @@
 #include "pch.h"
 #include <stdexcept>
 #include <unordered_map>
+#include <typeinfo>
 
 #include "Shape.h"
 #include "Intersect.h"
+#include "RayPacket.h"
+#include "Stats.h"
 
 using namespace ray;
 
@@ -13,12 +16,31 @@ Vec3 Shape::normal_at(const Point3& world_point, const Intersection& hit) const
 	return normal_to_world(local_normal);
 }
 
+Bounds Shape::parent_bounds() const {
+	Bounds b;
+	for (const auto& p : bounds().corners()) {
+		b.add(transform * p);
+	}
+	return b;
+}
+
 void Shape::intersect(const Ray& inr, IntersectionList& out) const {
+	if ((rays() & out.kind()) == 0) {
+		return;
+	}
 	Ray local_ray = transform.inverse_multiply(inr);
 
 	local_intersect(local_ray, out);
 }
 
+void Shape::intersect_packet(const RayPacket& packet, int mask, IntersectionList* out) const {
+	for (int i = 0; i < RayPacket::width; i++) {
+		if (mask & (1 << i)) {
+			intersect(packet.rays[i], out[i]);
+		}
+	}
+}
+
 Point3 Shape::world_to_object(Point3 point) const {
 	if (parent != nullptr) {
 		point = parent->world_to_object(point);
@@ -41,6 +63,11 @@ Vec3 Shape::normal_to_world(Vec3 normal) const {
 }
 
 void Sphere::local_intersect(const Ray& local_ray, IntersectionList& out) const {
+	unit_intersect(local_ray, this, out);
+}
+
+void Sphere::unit_intersect(const Ray& local_ray, const Shape* object, IntersectionList& out) {
+	count(&RayStats::sphere_tests);
 	Vec3 sphere_ray = local_ray.origin - Point3();
 	double a = local_ray.direction().dot(local_ray.direction());
 	double b = 2 * local_ray.direction().dot(sphere_ray);
@@ -53,19 +80,24 @@ void Sphere::local_intersect(const Ray& local_ray, IntersectionList& out) const
 	double mul = 1 / (2 * a);
 	double sqrtdisc = sqrt(discriminant);
 	double t1 = static_cast<double>((-b - sqrtdisc) * mul);
-	out.append(Intersection(t1, this));
+	out.append(Intersection(t1, object));
 	double t2 = static_cast<double>((-b + sqrtdisc) * mul);
-	out.append(Intersection(t2, this));
+	out.append(Intersection(t2, object));
 }
 
 void Plane::local_intersect(const Ray& local_ray, IntersectionList& out) const {
+	unit_intersect(local_ray, this, out);
+}
+
+void Plane::unit_intersect(const Ray& local_ray, const Shape* object, IntersectionList& out) {
+	count(&RayStats::plane_tests);
 	if (IsEqual(local_ray.direction().y, 0)) {
 		// Ray is perpendicular to plane, no intersection.
 		return;
 	}
 
 	double t = -local_ray.origin.y * local_ray.invdirection().y;
-	out.append(Intersection(t, this));
+	out.append(Intersection(t, object));
 }
 
 std::pair<double, double> Cube::check_axis(double bmin, double bmax, double origin, double invdirection) {
@@ -83,6 +115,11 @@ std::pair<double, double> Cube::check_axis(double bmin, double bmax, double orig
 }
 
 void Cube::local_intersect(const Ray& local_ray, IntersectionList& out) const {
+	unit_intersect(local_ray, this, out);
+}
+
+void Cube::unit_intersect(const Ray& local_ray, const Shape* object, IntersectionList& out) {
+	count(&RayStats::cube_tests);
 	auto [xmin, xmax] = check_axis(-1, 1, local_ray.origin.x, local_ray.invdirection().x);
 	auto [ymin, ymax] = check_axis(-1, 1, local_ray.origin.y, local_ray.invdirection().y);
 	auto [zmin, zmax] = check_axis(-1, 1, local_ray.origin.z, local_ray.invdirection().z);
@@ -92,15 +129,15 @@ void Cube::local_intersect(const Ray& local_ray, IntersectionList& out) const {
 	double tmax = std::min(xmax, std::min(ymax, zmax));
 
 	if (tmin < tmax) {
-		out.append(Intersection(tmin, this));
-		out.append(Intersection(tmax, this));
+		out.append(Intersection(tmin, object));
+		out.append(Intersection(tmax, object));
 	}
 }
 
 Vec3 Cube::local_normal_at(const Point3& local_point, const Intersection& hit) const {
-	double ax = abs(local_point.x);
-	double ay = abs(local_point.y);
-	double az = abs(local_point.z);
+	double ax = std::abs(local_point.x);
+	double ay = std::abs(local_point.y);
+	double az = std::abs(local_point.z);
 
 	double maxdim = std::max(ax, std::max(ay, az));
 
@@ -115,6 +152,11 @@ Vec3 Cube::local_normal_at(const Point3& local_point, const Intersection& hit) c
 }
 
 void Cylinder::local_intersect(const Ray& local_ray, IntersectionList& out) const {
+	unit_intersect(local_ray, this, minimum, maximum, closed, out);
+}
+
+void Cylinder::unit_intersect(const Ray& local_ray, const Shape* object, double minimum, double maximum, bool closed, IntersectionList& out) {
+	count(&RayStats::cylinder_tests);
 	double a = local_ray.direction().x * local_ray.direction().x + local_ray.direction().z * local_ray.direction().z;
 	if (!IsEqual(a, 0)) {
 		double b = 2 * (local_ray.origin.x * local_ray.direction().x + local_ray.origin.z * local_ray.direction().z);
@@ -136,35 +178,35 @@ void Cylinder::local_intersect(const Ray& local_ray, IntersectionList& out) cons
 
 		double y0 = local_ray.origin.y + t0 * local_ray.direction().y;
 		if (minimum < y0 && y0 < maximum) {
-			out.append(Intersection(t0, this));
+			out.append(Intersection(t0, object));
 		}
 
 		double y1 = local_ray.origin.y + t1 * local_ray.direction().y;
 		if (minimum < y1 && y1 < maximum) {
-			out.append(Intersection(t1, this));
+			out.append(Intersection(t1, object));
 		}
 	}
 
-	intersect_caps(local_ray, out);
+	intersect_caps(local_ray, object, minimum, maximum, closed, out);
 }
 
-void Cylinder::intersect_caps(const Ray& local_ray, IntersectionList& out) const {
+void Cylinder::intersect_caps(const Ray& local_ray, const Shape* object, double minimum, double maximum, bool closed, IntersectionList& out) {
 	if (!closed) {
 		return;
 	}
 
 	double t = (minimum - local_ray.origin.y) * local_ray.invdirection().y;
 	if (check_cap(local_ray, t)) {
-		out.append(Intersection(t, this));
+		out.append(Intersection(t, object));
 	}
 
 	t = (maximum - local_ray.origin.y) * local_ray.invdirection().y;
 	if (check_cap(local_ray, t)) {
-		out.append(Intersection(t, this));
+		out.append(Intersection(t, object));
 	}
 }
 
-bool Cylinder::check_cap(const Ray& ray, double t) const {
+bool Cylinder::check_cap(const Ray& ray, double t) {
 	double x = ray.origin.x + ray.direction().x * t;
 	double z = ray.origin.z + ray.direction().z * t;
 
@@ -188,6 +230,11 @@ Vec3 Cylinder::local_normal_at(const Point3& local_point, const Intersection& hi
 }
 
 void Cone::local_intersect(const Ray& local_ray, IntersectionList& out) const {
+	unit_intersect(local_ray, this, minimum, maximum, closed, out);
+}
+
+void Cone::unit_intersect(const Ray& local_ray, const Shape* object, double minimum, double maximum, bool closed, IntersectionList& out) {
+	count(&RayStats::cone_tests);
 	double a = local_ray.direction().x * local_ray.direction().x - local_ray.direction().y * local_ray.direction().y  + local_ray.direction().z * local_ray.direction().z;
 	double b = 2 * (local_ray.origin.x * local_ray.direction().x - local_ray.origin.y * local_ray.direction().y + local_ray.origin.z * local_ray.direction().z);
 	double c = local_ray.origin.x * local_ray.origin.x - local_ray.origin.y * local_ray.origin.y + local_ray.origin.z * local_ray.origin.z;
@@ -197,7 +244,7 @@ void Cone::local_intersect(const Ray& local_ray, IntersectionList& out) const {
 			double t = -c / (2 * b);
 			double y = local_ray.origin.y + t * local_ray.direction().y;
 			if (minimum < y && y < maximum) {
-				out.append(Intersection(t, this));
+				out.append(Intersection(t, object));
 			}
 		}
 	}
@@ -220,40 +267,40 @@ void Cone::local_intersect(const Ray& local_ray, IntersectionList& out) const {
 
 		double y0 = local_ray.origin.y + t0 * local_ray.direction().y;
 		if (minimum < y0 && y0 < maximum) {
-			out.append(Intersection(t0, this));
+			out.append(Intersection(t0, object));
 		}
 
 		double y1 = local_ray.origin.y + t1 * local_ray.direction().y;
 		if (minimum < y1 && y1 < maximum) {
-			out.append(Intersection(t1, this));
+			out.append(Intersection(t1, object));
 		}
 	}
 
-	intersect_caps(local_ray, out);
+	intersect_caps(local_ray, object, minimum, maximum, closed, out);
 }
 
-void Cone::intersect_caps(const Ray& local_ray, IntersectionList& out) const {
+void Cone::intersect_caps(const Ray& local_ray, const Shape* object, double minimum, double maximum, bool closed, IntersectionList& out) {
 	if (!closed) {
 		return;
 	}
 
 	// cone radius = cone Y = minimum for cap.
 	double t = (minimum - local_ray.origin.y) * local_ray.invdirection().y;
-	if (check_cap(local_ray, t, abs(minimum))) {
-		out.append(Intersection(t, this));
+	if (check_cap(local_ray, t, std::abs(minimum))) {
+		out.append(Intersection(t, object));
 	}
 
 	t = (maximum - local_ray.origin.y) * local_ray.invdirection().y;
-	if (check_cap(local_ray, t, abs(maximum))) {
-		out.append(Intersection(t, this));
+	if (check_cap(local_ray, t, std::abs(maximum))) {
+		out.append(Intersection(t, object));
 	}
 }
 
-bool Cone::check_cap(const Ray& ray, double t, double radius) const {
+bool Cone::check_cap(const Ray& ray, double t, double radius) {
 	double x = ray.origin.x + ray.direction().x * t;
 	double z = ray.origin.z + ray.direction().z * t;
 
-	return (x * x + z * z) <= radius;
+	return (x * x + z * z) <= radius * radius;
 }
 
 Vec3 Cone::local_normal_at(const Point3& local_point, const Intersection& hit) const {
@@ -280,6 +327,11 @@ Vec3 Cone::local_normal_at(const Point3& local_point, const Intersection& hit) c
 // Moller-Trumbore algorithm
 // https://www.scratchapixel.com/lessons/3d-basic-rendering/ray-tracing-rendering-a-triangle/moller-trumbore-ray-triangle-intersection
 void Triangle::local_intersect(const Ray& local_ray, IntersectionList& out) const {
+	unit_intersect(local_ray, this, p1, e1, e2, out);
+}
+
+void Triangle::unit_intersect(const Ray& local_ray, const Shape* object, const Point3& p1, const Vec3& e1, const Vec3& e2, IntersectionList& out) {
+	count(&RayStats::triangle_tests);
 	Vec3 dir_cross_e2 = local_ray.direction().cross(e2);
 	double det = e1.dot(dir_cross_e2);
 	if (IsEqual(det, 0)) {
@@ -304,7 +356,7 @@ void Triangle::local_intersect(const Ray& local_ray, IntersectionList& out) cons
 	}
 
 	double t = f * e2.dot(origin_cross_e1);
-	out.append(Intersection(t, this, u, v));
+	out.append(Intersection(t, object, u, v));
 }
 
 Vec3 Triangle::local_normal_at(const Point3& local_point, const Intersection& hit) const {
@@ -316,8 +368,8 @@ Vec3 SmoothTriangle::local_normal_at(const Point3& local_point, const Intersecti
 }
 
 void Group::local_intersect(const Ray& local_ray, IntersectionList& out) const {
-	if (_shapes.size() == 0) {
-		// nothing to intersect.
+	if (_shapes.size() == 0 || (rays() & out.kind()) == 0) {
+		// nothing to intersect, or nothing this kind of ray sees.
 		return;
 	}
 
@@ -340,11 +392,233 @@ void Group::local_intersect(const Ray& local_ray, IntersectionList& out) const {
 		if (tmin > zmax || zmin > tmax) {
 			return;
 		}
+
+		// entered past the nearest hit so far.
+		if (out.past(std::max(tmin, zmin))) {
+			return;
+		}
+	}
+
+	intersect_children(local_ray, out);
+}
+
+void Group::intersect_triangles(const Ray& local_ray, IntersectionList& out) const {
+	float4 ox = splat(static_cast<float>(local_ray.origin.x));
+	float4 oy = splat(static_cast<float>(local_ray.origin.y));
+	float4 oz = splat(static_cast<float>(local_ray.origin.z));
+	float4 dx = splat(static_cast<float>(local_ray.direction().x));
+	float4 dy = splat(static_cast<float>(local_ray.direction().y));
+	float4 dz = splat(static_cast<float>(local_ray.direction().z));
+
+	for (const auto& pack : _triangles) {
+		int mask = pack.hit_mask(ox, oy, oz, dx, dy, dz);
+		for (int lane = 0; mask != 0; lane++, mask >>= 1) {
+			if (mask & 1) {
+				// confirm in double, so hits match the one at a time path exactly. Packed triangles have no transform.
+				pack.triangle[lane]->Triangle::local_intersect(local_ray, out);
+			}
+		}
+	}
+}
+
+void Group::intersect_children(const Ray& local_ray, IntersectionList& out) const {
+	count(&RayStats::nodes_visited);
+	if (!_triangles.empty()) {
+		intersect_triangles(local_ray, out);
+		if (out.done()) {
+			return;
+		}
+	}
+
+	float4 ox = splat(static_cast<float>(local_ray.origin.x));
+	float4 oy = splat(static_cast<float>(local_ray.origin.y));
+	float4 oz = splat(static_cast<float>(local_ray.origin.z));
+	float4 ix = splat(float_inv(local_ray.invdirection().x));
+	float4 iy = splat(float_inv(local_ray.invdirection().y));
+	float4 iz = splat(float_inv(local_ray.invdirection().z));
+	float4 px = splat(origin_pad(local_ray.origin.x));
+	float4 py = splat(origin_pad(local_ray.origin.y));
+	float4 pz = splat(origin_pad(local_ray.origin.z));
+
+	struct ChildHit {
+		float t;
+		size_t index;
+	};
+
+	// Wide nodes have at most 2 packs worth of children (spatialize makes up to 8 buckets),
+	// bigger flat groups are walked in batches of that size.
+	constexpr size_t batch_packs = 2;
+	std::array<ChildHit, batch_packs * simd_width> hits;
+	uint8_t kind = out.kind();
+
+	for (size_t first = 0; first < _child_bounds.size(); first += batch_packs) {
+		size_t count = 0;
+		size_t last = std::min(first + batch_packs, _child_bounds.size());
+		for (size_t p = first; p < last; p++) {
+			float tnear[simd_width];
+			int mask = _child_bounds[p].hit_mask(ox, oy, oz, ix, iy, iz, px, py, pz, tnear);
+
+			for (size_t lane = 0; lane < simd_width; lane++) {
+				// children nothing in which this kind of ray sees, or entered past the nearest hit so far, are skipped
+				// before descending.
+				if ((mask & (1 << lane)) && (_refs[p * simd_width + lane].rays & kind) && !out.past(tnear[lane])) {
+					ChildHit h{ tnear[lane], p * simd_width + lane };
+
+					// insertion sort, near to far.
+					size_t i = count++;
+					while (i > 0 && hits[i - 1].t > h.t) {
+						hits[i] = hits[i - 1];
+						i--;
+					}
+					hits[i] = h;
+				}
+			}
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			// the rest of the batch is further still, a later batch may not be.
+			if (out.past(hits[i].t)) {
+				break;
+			}
+			intersect_child(hits[i].index, local_ray, out);
+			if (out.done()) {
+				return;
+			}
+		}
 	}
+}
 
-	for (auto& shape : _shapes) {
-		shape->intersect(local_ray, out);
+void Group::intersect_child(size_t index, const Ray& local_ray, IntersectionList& out) const {
+	const ChildRef& ref = _refs[index];
+	if (ref.type == ChildType::Shape) {
+		_shapes[index]->intersect(local_ray, out);
+		return;
 	}
+
+	const Primitive& p = _primitives[ref.index];
+	Ray ray = p.to_local(local_ray);
+	switch (ref.type) {
+	case ChildType::Sphere:
+		Sphere::unit_intersect(ray, p.shape, out);
+		break;
+	case ChildType::Plane:
+		Plane::unit_intersect(ray, p.shape, out);
+		break;
+	case ChildType::Cube:
+		Cube::unit_intersect(ray, p.shape, out);
+		break;
+	case ChildType::Cylinder:
+		Cylinder::unit_intersect(ray, p.shape, p.param[0], p.param[1], p.closed, out);
+		break;
+	case ChildType::Cone:
+		Cone::unit_intersect(ray, p.shape, p.param[0], p.param[1], p.closed, out);
+		break;
+	case ChildType::Triangle:
+		Triangle::unit_intersect(ray, p.shape, Point3(p.param[0], p.param[1], p.param[2]),
+			Vec3(p.param[3], p.param[4], p.param[5]), Vec3(p.param[6], p.param[7], p.param[8]), out);
+		break;
+	default:
+		break;
+	}
+}
+
+Ray Group::Primitive::to_local(const Ray& r) const {
+	const std::array<double, 12>& m = inverse;
+	const Point3& o = r.origin;
+	const Vec3& d = r.direction();
+	return Ray(
+		Point3(
+			o.x * m[0] + o.y * m[1] + o.z * m[2] + m[3],
+			o.x * m[4] + o.y * m[5] + o.z * m[6] + m[7],
+			o.x * m[8] + o.y * m[9] + o.z * m[10] + m[11]),
+		Vec3(
+			d.x * m[0] + d.y * m[1] + d.z * m[2] + d.w * m[3],
+			d.x * m[4] + d.y * m[5] + d.z * m[6] + d.w * m[7],
+			d.x * m[8] + d.y * m[9] + d.z * m[10] + d.w * m[11],
+			d.w));
+}
+
+void Group::intersect_packet(const RayPacket& packet, int mask, IntersectionList* out) const {
+	RayPacket local_packet = packet.inverse_multiply(transform);
+
+	local_intersect_packet(local_packet, mask, out);
+}
+
+void Group::local_intersect_packet(const RayPacket& local_packet, int mask, IntersectionList* out) const {
+	// every list of a packet collects the same kind of ray.
+	uint8_t kind = out[0].kind();
+	if (_shapes.size() == 0 || (rays() & kind) == 0) {
+		// nothing to intersect, or nothing this kind of ray sees.
+		return;
+	}
+
+	// Same slab test as local_intersect, but the node is fetched and tested once for all rays.
+	float tnear[RayPacket::width];
+	mask = past_lanes(local_packet.hit_mask(_packet_bounds, mask, tnear), tnear, out);
+	if (mask == 0) {
+		return;
+	}
+
+	if ((mask & (mask - 1)) == 0) {
+		// Rays diverged, only one left. Finish it on the single ray path.
+		int lane = 0;
+		while ((mask & (1 << lane)) == 0) {
+			lane++;
+		}
+
+		intersect_children(local_packet.rays[lane], out[lane]);
+		return;
+	}
+
+	if constexpr (stats_enabled) {
+		int lanes = 0;
+		for (int m = mask; m != 0; m &= m - 1) {
+			lanes++;
+		}
+		count(&RayStats::nodes_visited, lanes);
+	}
+
+	for (size_t i = 0; i < _shapes.size(); i++) {
+		ChildType type = _refs[i].type;
+		if ((_refs[i].rays & kind) == 0 || type == ChildType::Packed) {
+			continue;
+		}
+		if (type == ChildType::Shape) {
+			_shapes[i]->intersect_packet(local_packet, mask, out);
+			continue;
+		}
+
+		// primitive: its box is tested once for all rays, the exact test only runs for rays that hit it.
+		int hits = past_lanes(local_packet.hit_mask(_child_bounds[i / simd_width].get(i % simd_width), mask, tnear), tnear, out);
+		for (int lane = 0; hits != 0; lane++, hits >>= 1) {
+			if (hits & 1) {
+				intersect_child(i, local_packet.rays[lane], out[lane]);
+			}
+		}
+	}
+
+	// each triangle is filtered against all rays at once, then confirmed in double per ray, as intersect_triangles.
+	for (const auto& pack : _triangles) {
+		int masks[simd_width];
+		local_packet.hit_masks(pack, mask, masks);
+		for (int t = 0; t < simd_width; t++) {
+			int hits = masks[t];
+			for (int lane = 0; hits != 0; lane++, hits >>= 1) {
+				if (hits & 1) {
+					pack.triangle[t]->Triangle::local_intersect(local_packet.rays[lane], out[lane]);
+				}
+			}
+		}
+	}
+}
+
+int Group::past_lanes(int mask, const float* tnear, const IntersectionList* out) {
+	for (int lane = 0; lane < RayPacket::width; lane++) {
+		if ((mask & (1 << lane)) && out[lane].past(tnear[lane])) {
+			mask &= ~(1 << lane);
+		}
+	}
+	return mask;
 }
 
 Vec3 Group::local_normal_at(const Point3& local_point, const Intersection& hit) const {
@@ -355,15 +629,119 @@ Vec3 Group::local_normal_at(const Point3& local_point, const Intersection& hit)
 void Group::add(std::unique_ptr<Shape> shape) {
 	shape->parent = this;
 
-	Bounds b = shape->bounds();
-	std::array<Point3, 8> corners = b.corners();
+	Bounds child = shape->parent_bounds();
+	_bounds.add(child);
+	_packet_bounds = FloatBounds(_bounds);
+	_rays_below |= shape->rays();
+
+	_shapes.push_back(std::move(shape));
+	pack_child(_shapes.size() - 1, child);
+}
 
-	for (const auto& p : corners) {
-		Point3 w = shape->transform * p;
-		_bounds.add(w);
+void Group::pack_child(size_t index, const Bounds& child) {
+	if (index % simd_width == 0) {
+		_child_bounds.emplace_back();
 	}
 
-	_shapes.push_back(std::move(shape));
+	// exact types only, a subclass may override local_intersect.
+	const Shape* shape = _shapes[index].get();
+	const std::type_info& type = typeid(*shape);
+	bool triangle = type == typeid(Triangle) || type == typeid(SmoothTriangle);
+	uint8_t rays = shape->rays();
+
+	// packs are tested by every ray, triangles hidden from some rays are tested on their own.
+	if (triangle && shape->transform.is_identity() && rays == AllRays) {
+		const Triangle* tri = static_cast<const Triangle*>(shape);
+		if (_triangles.empty() || _triangles.back().active == (1 << simd_width) - 1) {
+			_triangles.emplace_back();
+		}
+		TrianglePack& pack = _triangles.back();
+		int lane = 0;
+		while (pack.active & (1 << lane)) {
+			lane++;
+		}
+		pack.set(lane, tri, tri->p1, tri->e1, tri->e2);
+		_refs.push_back({ ChildType::Packed, rays, 0 });
+		return;
+	}
+
+	_child_bounds.back().set(index % simd_width, FloatBounds(child));
+
+	Primitive p = {};
+	ChildType kind = ChildType::Shape;
+	if (type == typeid(Sphere)) {
+		kind = ChildType::Sphere;
+	}
+	else if (type == typeid(Plane)) {
+		kind = ChildType::Plane;
+	}
+	else if (type == typeid(Cube)) {
+		kind = ChildType::Cube;
+	}
+	else if (type == typeid(Cylinder)) {
+		const Cylinder* cyl = static_cast<const Cylinder*>(shape);
+		kind = ChildType::Cylinder;
+		p.param[0] = cyl->minimum;
+		p.param[1] = cyl->maximum;
+		p.closed = cyl->closed;
+	}
+	else if (type == typeid(Cone)) {
+		const Cone* cone = static_cast<const Cone*>(shape);
+		kind = ChildType::Cone;
+		p.param[0] = cone->minimum;
+		p.param[1] = cone->maximum;
+		p.closed = cone->closed;
+	}
+	else if (triangle) {
+		const Triangle* tri = static_cast<const Triangle*>(shape);
+		kind = ChildType::Triangle;
+		const double v[9] = { tri->p1.x, tri->p1.y, tri->p1.z, tri->e1.x, tri->e1.y, tri->e1.z, tri->e2.x, tri->e2.y, tri->e2.z };
+		std::copy(std::begin(v), std::end(v), p.param);
+	}
+
+	if (kind == ChildType::Shape) {
+		_refs.push_back({ ChildType::Shape, rays, 0 });
+		return;
+	}
+
+	p.shape = shape;
+	std::array<double, 16> inv = shape->transform.inverse().to_array();
+	std::copy(inv.begin(), inv.begin() + 12, p.inverse.begin());
+	_refs.push_back({ kind, rays, static_cast<uint32_t>(_primitives.size()) });
+	_primitives.push_back(p);
+}
+
+Bounds Instance::bounds() const {
+	return mesh->parent_bounds();
+}
+
+Vec3 Instance::local_normal_at(const Point3& local_point, const Intersection& hit) const {
+	throw std::runtime_error("its always an error to call instance local_normal_at, hits record the mesh shape");
+}
+
+void Instance::local_intersect(const Ray& local_ray, IntersectionList& out) const {
+	out.set_instance(this);
+	mesh->intersect(local_ray, out);
+	out.set_instance(nullptr);
+}
+
+bool Group::refit() {
+	Bounds old = _bounds;
+	uint8_t old_rays = _rays_below;
+	_bounds = Bounds();
+	_child_bounds.clear();
+	_triangles.clear();
+	_refs.clear();
+	_primitives.clear();
+	_rays_below = 0;
+	for (size_t i = 0; i < _shapes.size(); i++) {
+		Bounds child = _shapes[i]->parent_bounds();
+		_bounds.add(child);
+		_rays_below |= _shapes[i]->rays();
+		pack_child(i, child);
+	}
+	_packet_bounds = FloatBounds(_bounds);
+	return _bounds != old || _rays_below != old_rays;
 }
 
 // In large scenes (1000 shapes), intersections are currently ~90% of cpu time. The goal is to get this smaller. Manually bucketing gets a 4x improvement. This tries to automate the process.
@@ -382,7 +760,7 @@ std::vector<std::unique_ptr<Shape>> NoopGroup::spatialize(std::vector<std::uniqu
 
 	if (shapes.size() < 8) {
 		// No point in bucketizing small lists.
-		return shapes;
+		return std::move(shapes);
 	}
 
 	std::unordered_map<Shape*, Bounds> txbounds;
@@ -403,7 +781,7 @@ std::vector<std::unique_ptr<Shape>> NoopGroup::spatialize(std::vector<std::uniqu
 	if (cumulative.area() < 0.0001) {
 		// Some models have big clusters of very tiny shapes, leading to infinite recursion trying to divide space.
 		// (eg. Stanford bunny ported to OBJ by McGuire Computer Graphics Archive)
-		return shapes;
+		return std::move(shapes);
 	}
 
 	// Set aside huge area shapes.
@@ -474,7 +852,7 @@ std::vector<std::unique_ptr<Shape>> NoopGroup::spatialize(std::vector<std::uniqu
 	int64_t buckets = std::count_if(std::begin(bucket), std::end(bucket), [](auto& b) { return b.min_shape != nullptr; });
 	if (buckets < 2) {
 		shapes.insert(shapes.end(), std::make_move_iterator(huge.begin()), std::make_move_iterator(huge.end()));
-		return shapes;
+		return std::move(shapes);
 	}
 
 	// Foreach shape, add to bucket where it adds the least bounds.
@@ -522,6 +900,15 @@ std::vector<std::unique_ptr<Shape>> NoopGroup::spatialize(std::vector<std::uniqu
 			continue;
 		}
 
+		if (b.vec.size() == 1) {
+			// no point in a group of one.
+			spatialized.push_back(std::move(b.vec.back()));
+			continue;
+		}
+
+		// bucket contents were collapsed by the recursion, only this level is left.
+		open_children(b.vec, simd_width);
+
 		auto group = std::make_unique<NoopGroup>();
 
 		while (!b.vec.empty()) {
@@ -534,4 +921,56 @@ std::vector<std::unique_ptr<Shape>> NoopGroup::spatialize(std::vector<std::uniqu
 	}
 
 	return spatialized;
-}
\ No newline at end of file
+}
+void NoopGroup::open_children(std::vector<std::unique_ptr<Shape>>& shapes, size_t width) {
+	// Greedily open the biggest child group that still fits, big groups are the ones most rays enter anyway.
+	for (;;) {
+		size_t best = shapes.size();
+		double best_area = -1;
+		for (size_t i = 0; i < shapes.size(); i++) {
+			NoopGroup* g = dynamic_cast<NoopGroup*>(shapes[i].get());
+			if (g == nullptr || shapes.size() - 1 + g->size() > width) {
+				continue;
+			}
+
+			double area = g->bounds().area();
+			if (area > best_area) {
+				best_area = area;
+				best = i;
+			}
+		}
+
+		if (best == shapes.size()) {
+			break;
+		}
+
+		std::unique_ptr<Shape> opened = std::move(shapes[best]);
+		shapes.erase(shapes.begin() + best);
+		auto children = static_cast<NoopGroup*>(opened.get())->extract_shapes();
+		for (auto& c : children) {
+			c->parent = nullptr;
+		}
+		shapes.insert(shapes.end(), std::make_move_iterator(children.begin()), std::make_move_iterator(children.end()));
+	}
+}
+
+std::vector<std::unique_ptr<Shape>> NoopGroup::collapse(std::vector<std::unique_ptr<Shape>>&& shapes, size_t width) {
+	open_children(shapes, width);
+
+	// Collapse below us too. Groups are rebuilt since their child bounds are cached on add.
+	for (auto& s : shapes) {
+		NoopGroup* g = dynamic_cast<NoopGroup*>(s.get());
+		if (g == nullptr) {
+			continue;
+		}
+
+		auto children = collapse(g->extract_shapes(), width);
+		auto rebuilt = std::make_unique<NoopGroup>();
+		for (auto& c : children) {
+			rebuilt->add(std::move(c));
+		}
+		s = std::move(rebuilt);
+	}
+
+	return std::move(shapes);
+}
@@ -2,18 +2,35 @@
 #include <memory_resource>  
 #include "Matrix.h"
 #include "Material.h"
+#include "Simd.h"
+#include "RenderSettings.h"
 
 // todo: lots of duplicate code (eg. cone&cylinder, cube&aabb)
 
 namespace ray {
 	class Intersection;
 	class IntersectionList;
+	class RayPacket;
+
+	// Kinds of ray, as bits. Shapes are only tested by the kinds in Shape::rays().
+	enum RayKind : uint8_t {
+		CameraRay = 1,
+		// reflected and refracted rays.
+		SecondaryRay = 2,
+		ShadowRay = 4,
+		AllRays = CameraRay | SecondaryRay | ShadowRay,
+	};
 
 	class Shape {
 	public:
 		Matrix4 transform;
 		Material material;
 		Shape* parent = nullptr;
+		// Which rays see the shape, for groups everything in them. Eg. a backdrop that shouldn't shadow, or a light fixture
+		// the camera looks through. Groups gather them as children are added, change them later through World::update.
+		bool visible_to_camera = true;
+		bool visible_in_reflections = true;
+		bool cast_shadows = true;
 
 		Shape() = default;
 		Shape(const Matrix4& t) : transform(t) {}
@@ -30,17 +47,32 @@ namespace ray {
 		}
 
 		virtual Bounds bounds() const = 0;
+		// bounds() moved into parent space by transform.
+		Bounds parent_bounds() const;
 
 		virtual Vec3 local_normal_at(const Point3& world_point, const Intersection& hit) const = 0;
 
 		Vec3 normal_at(const Point3& world_point, const Intersection& hit) const;
 		virtual void local_intersect(const Ray& inr, IntersectionList& out) const = 0;
 		virtual void intersect(const Ray& inr, IntersectionList& out) const;
+		// Intersects the rays of packet selected by mask, out[i] receives hits of packet.rays[i].
+		// Default falls back to one ray at a time.
+		virtual void intersect_packet(const RayPacket& packet, int mask, IntersectionList* out) const;
 		Point3 world_to_object(Point3 point) const;
 		Vec3 normal_to_world(Vec3 normal) const;
 		virtual void update_material(const Material& mat) {
 			material = mat;
 		}
+
+		// RayKinds that can hit the shape (or for groups, something inside it).
+		uint8_t rays() const {
+			uint8_t own = (visible_to_camera ? CameraRay : 0) | (visible_in_reflections ? SecondaryRay : 0) | (cast_shadows ? ShadowRay : 0);
+			return own & _rays_below;
+		}
+
+	protected:
+		// Groups: union of their children's rays(), so subtrees nothing in which a ray kind can hit are skipped whole.
+		uint8_t _rays_below = AllRays;
 	};
 
 	class Sphere : public Shape
@@ -70,6 +102,8 @@ namespace ray {
 		}
 
 		void local_intersect(const Ray& local_ray, IntersectionList& out) const override;
+		// local_intersect with hits on object, so Group can test a flattened copy without the Sphere itself.
+		static void unit_intersect(const Ray& local_ray, const Shape* object, IntersectionList& out);
 
 		// Returns a glass sphere.
 		static std::unique_ptr<Sphere> glass() {
@@ -107,6 +141,7 @@ namespace ray {
 		}
 
 		void local_intersect(const Ray& local_ray, IntersectionList& out) const override;
+		static void unit_intersect(const Ray& local_ray, const Shape* object, IntersectionList& out);
 	};
 
 	class Cube : public Shape
@@ -133,6 +168,7 @@ namespace ray {
 
 		Vec3 local_normal_at(const Point3& local_point, const Intersection& hit) const override;
 		void local_intersect(const Ray& local_ray, IntersectionList& out) const override;
+		static void unit_intersect(const Ray& local_ray, const Shape* object, IntersectionList& out);
 
 		static std::pair<double, double> check_axis(double bmin, double bmax, double origin, double direction);
 	};
@@ -140,6 +176,7 @@ namespace ray {
 	class Cylinder : public Shape
 	{
 	public:
+		// Groups copy these when the cylinder is added, change them later through World::update.
 		double minimum = -std::numeric_limits<double>::max();
 		double maximum = std::numeric_limits<double>::max();
 		bool closed = false;
@@ -165,16 +202,18 @@ namespace ray {
 
 		Vec3 local_normal_at(const Point3& local_point, const Intersection& hit) const override;
 		void local_intersect(const Ray& local_ray, IntersectionList& out) const override;
+		static void unit_intersect(const Ray& local_ray, const Shape* object, double minimum, double maximum, bool closed, IntersectionList& out);
 
 	private:
-		void intersect_caps(const Ray& local_ray, IntersectionList& out) const;
-		bool check_cap(const Ray& ray, double t) const;
+		static void intersect_caps(const Ray& local_ray, const Shape* object, double minimum, double maximum, bool closed, IntersectionList& out);
+		static bool check_cap(const Ray& ray, double t);
 
 	};
 
 	class Cone : public Shape
 	{
 	public:
+		// As Cylinder's.
 		double minimum = -std::numeric_limits<double>::max();
 		double maximum = std::numeric_limits<double>::max();
 		bool closed = false;
@@ -200,10 +239,11 @@ namespace ray {
 
 		Vec3 local_normal_at(const Point3& local_point, const Intersection& hit) const override;
 		void local_intersect(const Ray& local_ray, IntersectionList& out) const override;
+		static void unit_intersect(const Ray& local_ray, const Shape* object, double minimum, double maximum, bool closed, IntersectionList& out);
 
 	private:
-		void intersect_caps(const Ray& local_ray, IntersectionList& out) const;
-		bool check_cap(const Ray& ray, double t, double radius) const;
+		static void intersect_caps(const Ray& local_ray, const Shape* object, double minimum, double maximum, bool closed, IntersectionList& out);
+		static bool check_cap(const Ray& ray, double t, double radius);
 
 	};
 
@@ -241,6 +281,7 @@ namespace ray {
 
 		Vec3 local_normal_at(const Point3& local_point, const Intersection& hit) const override;
 		void local_intersect(const Ray& local_ray, IntersectionList& out) const override;
+		static void unit_intersect(const Ray& local_ray, const Shape* object, const Point3& p1, const Vec3& e1, const Vec3& e2, IntersectionList& out);
 	};
 
 	class SmoothTriangle : public Triangle {
@@ -293,8 +334,12 @@ namespace ray {
 	public:
 		Bounds _bounds;
 
-		Group() = default;
-		Group(const Matrix4& t) : Shape(t) {}
+		Group() {
+			_rays_below = 0;
+		}
+		Group(const Matrix4& t) : Shape(t) {
+			_rays_below = 0;
+		}
 
 		friend std::ostream& operator<<(std::ostream& os, const Group& rhs) {
 			return os << "Group(" << rhs.transform << ", " << rhs.material << ")";
@@ -311,6 +356,8 @@ namespace ray {
 		Bounds bounds() const override { return _bounds; }
 		Vec3 local_normal_at(const Point3& local_point, const Intersection& hit) const override;
 		void local_intersect(const Ray& local_ray, IntersectionList& out) const override;
+		void intersect_packet(const RayPacket& packet, int mask, IntersectionList* out) const override;
+		void local_intersect_packet(const RayPacket& local_packet, int mask, IntersectionList* out) const;
 		virtual void update_material(const Material& mat) override{
 			material = mat;
 			for (auto& s : _shapes) {
@@ -325,28 +372,145 @@ namespace ray {
 
 		void add(std::unique_ptr<Shape> shape);
 
+		// Recomputes bounds and repacks children, after a child moved or changed. Returns true if our bounds or rays() changed.
+		bool refit();
+
 		const std::vector<std::unique_ptr<Shape>>& shapes() const {
 			return _shapes;
 		}
 
 		// removes group shape array
 		std::vector<std::unique_ptr<Shape>> extract_shapes() {
+			_child_bounds.clear();
+			_triangles.clear();
+			_refs.clear();
+			_primitives.clear();
+			_rays_below = 0;
 			return std::move(_shapes);
 		}
 
+	protected:
+		// Intersects children whose bounds local_ray hits, nearest first. Skips the test against our own bounds.
+		void intersect_children(const Ray& local_ray, IntersectionList& out) const;
+
 	private:
+		// How a child is tested: packed in _triangles, flattened into _primitives (by type), or through Shape::intersect.
+		enum class ChildType : uint8_t { Shape, Packed, Sphere, Plane, Cube, Cylinder, Cone, Triangle };
+
+		struct ChildRef {
+			ChildType type;
+			// the child's rays().
+			uint8_t rays;
+			// into _primitives for flattened children.
+			uint32_t index;
+		};
+
+		// Copy of a primitive child holding just what its test reads, so testing it needs neither a virtual call nor the child.
+		struct Primitive {
+			// Intersection::object of hits.
+			const Shape* shape;
+			// top 3 rows of the child's inverse transform.
+			std::array<double, 12> inverse;
+			// Cylinder, Cone: minimum, maximum. Triangle: p1, e1, e2.
+			double param[9];
+			bool closed;
+
+			// Same result as shape->transform.inverse_multiply(r).
+			Ray to_local(const Ray& r) const;
+		};
+
 		std::vector<std::unique_ptr<Shape>> _shapes;
+		// float copy of _bounds for packet slab tests.
+		FloatBounds _packet_bounds;
+		// Child bounds (in our space) in SoA packs of simd_width, _child_bounds[i / simd_width] lane i % simd_width is _shapes[i].
+		// Lanes of packed triangles are left inactive.
+		std::vector<BoundsPack> _child_bounds;
+		// Triangle children without a transform (ie. mesh faces), tested simd_width at a time instead of box then triangle.
+		std::vector<TrianglePack> _triangles;
+		// _refs[i] says how _shapes[i] is tested.
+		std::vector<ChildRef> _refs;
+		std::vector<Primitive> _primitives;
+
+		// Adds _shapes[index] to _child_bounds and _refs, and to _triangles or _primitives.
+		void pack_child(size_t index, const Bounds& child);
+		void intersect_child(size_t index, const Ray& local_ray, IntersectionList& out) const;
+		void intersect_triangles(const Ray& local_ray, IntersectionList& out) const;
+		// mask without the lanes whose out list is past() their entry distance tnear.
+		static int past_lanes(int mask, const float* tnear, const IntersectionList* out);
+	};
+
+	// Places a shared mesh (eg. a group loaded from a file) in the scene without copying it.
+	// Hits inside the mesh are tagged with the instance (see IntersectionList::instance), which adds its transform (and
+	// material, if overridden) when shading.
+	// Meshes keep parent == nullptr, and can't contain instances themselves.
+	class Instance : public Shape
+	{
+	public:
+		std::shared_ptr<const Shape> mesh;
+		// Shade with Shape::material instead of the mesh's own materials.
+		bool override_material = false;
+
+		Instance(std::shared_ptr<const Shape> m) : mesh(std::move(m)) {}
+		Instance(std::shared_ptr<const Shape> m, const Matrix4& t) : Shape(t), mesh(std::move(m)) {}
+
+		friend std::ostream& operator<<(std::ostream& os, const Instance& rhs) {
+			return os << "Instance(" << rhs.transform << ", " << rhs.material << ")";
+		}
+
+		// mesh bounds, in mesh parent (ie. our local) space.
+		Bounds bounds() const override;
+
+		Vec3 local_normal_at(const Point3& local_point, const Intersection& hit) const override;
+		void local_intersect(const Ray& local_ray, IntersectionList& out) const override;
+
+		void update_material(const Material& mat) override {
+			material = mat;
+			override_material = true;
+		}
 	};
 
 	// A group without a transform, used by spatialize.
 	class NoopGroup : public Group {
 		void intersect(const Ray& local_ray, IntersectionList& out) const override {
+			if (parent != nullptr) {
+				// parent group already tested our bounds as one of its children.
+				return intersect_children(local_ray, out);
+			}
 			return local_intersect(local_ray, out);
 		}
 
+		void intersect_packet(const RayPacket& packet, int mask, IntersectionList* out) const override {
+			return local_intersect_packet(packet, mask, out);
+		}
+
 	public:
+		// Surface area when built, set on first refit. Used to tell when refits have made the tree too loose.
+		double built_area = -1;
+
 		// Inserts NoopGroups into shapes to get spatial locality. Reducing intersection 20x in some scenes.
 		static std::vector<std::unique_ptr<Shape>> spatialize(std::vector<std::unique_ptr<Shape>>&& shapes, int loop = 0);
+
+		// Inserts NoopGroups by sorting shapes along a Morton curve. Builds in about linear time, but trees are looser than spatialize's.
+		// For huge meshes and previews, where build time dominates.
+		static std::vector<std::unique_ptr<Shape>> lbvh(std::vector<std::unique_ptr<Shape>>&& shapes);
+
+		// Inserts NoopGroups by splitting where the surface area heuristic predicts the fewest ray/shape tests.
+		// Splits are picked from 16 bins per node. Big nodes are binned, and their subtrees built, on several threads.
+		static std::vector<std::unique_ptr<Shape>> sah(std::vector<std::unique_ptr<Shape>>&& shapes);
+
+		// Moves shapes without finite bounds (planes, uncapped cylinders and cones) out of shapes, and returns them.
+		static std::vector<std::unique_ptr<Shape>> take_unbounded(std::vector<std::unique_ptr<Shape>>& shapes);
+
+		// spatialize, lbvh or sah, as picked by mode.
+		static std::vector<std::unique_ptr<Shape>> build(std::vector<std::unique_ptr<Shape>>&& shapes, BuildMode mode);
+
+		// Pulls the children of NoopGroups up into shapes while they fit in width, recursively.
+		// Turns deep narrow trees into wide nodes whose children are tested with one SIMD slab test.
+		static std::vector<std::unique_ptr<Shape>> collapse(std::vector<std::unique_ptr<Shape>>&& shapes, size_t width = simd_width);
+
+	private:
+		// collapse, without recursing into the remaining groups.
+		static void open_children(std::vector<std::unique_ptr<Shape>>& shapes, size_t width);
 	};
 
 
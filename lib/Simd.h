@@ -0,0 +1,338 @@
+#pragma once
+#include <cfloat>
+#include <cmath>
+#include <algorithm>
+#include "Tuple.h"
+
+// 4-wide float helpers shared by the packet and wide node traversal.
+// SSE where the target has it (every x64 target does, so no special compiler flags are needed), plain loops over
+// 4 floats elsewhere. Both round, compare and handle NaN alike, so results don't depend on the target.
+// Define RAY_NO_SIMD to build the loops on an SSE target.
+#if (defined(__SSE__) || defined(_M_X64)) && !defined(RAY_NO_SIMD)
+#define RAY_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace ray {
+	class Triangle;
+
+	// Lanes per SSE register, also the width of wide BVH nodes.
+	constexpr int simd_width = 4;
+
+	// simd_width floats, an SSE register.
+	struct float4 {
+#ifdef RAY_SSE
+		__m128 v;
+#else
+		float v[simd_width];
+#endif
+	};
+
+	// Per lane result of comparing float4s.
+	struct mask4 {
+#ifdef RAY_SSE
+		__m128 v;
+#else
+		int bits;
+#endif
+	};
+
+#ifdef RAY_SSE
+	inline float4 splat(float f) { return { _mm_set1_ps(f) }; }
+	// p is 16 byte aligned.
+	inline float4 load4(const float* p) { return { _mm_load_ps(p) }; }
+	inline void store4(float* p, float4 a) { _mm_storeu_ps(p, a.v); }
+
+	inline float4 operator+(float4 a, float4 b) { return { _mm_add_ps(a.v, b.v) }; }
+	inline float4 operator-(float4 a, float4 b) { return { _mm_sub_ps(a.v, b.v) }; }
+	inline float4 operator*(float4 a, float4 b) { return { _mm_mul_ps(a.v, b.v) }; }
+	inline float4 operator/(float4 a, float4 b) { return { _mm_div_ps(a.v, b.v) }; }
+	// b when either is NaN.
+	inline float4 min4(float4 a, float4 b) { return { _mm_min_ps(a.v, b.v) }; }
+	inline float4 max4(float4 a, float4 b) { return { _mm_max_ps(a.v, b.v) }; }
+	inline float4 abs4(float4 a) { return { _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v) }; }
+
+	inline mask4 operator<=(float4 a, float4 b) { return { _mm_cmple_ps(a.v, b.v) }; }
+	inline mask4 operator>=(float4 a, float4 b) { return { _mm_cmpge_ps(a.v, b.v) }; }
+	inline mask4 operator&(mask4 a, mask4 b) { return { _mm_and_ps(a.v, b.v) }; }
+	inline mask4 operator|(mask4 a, mask4 b) { return { _mm_or_ps(a.v, b.v) }; }
+	// bit i is set when lane i is.
+	inline int movemask(mask4 m) { return _mm_movemask_ps(m.v); }
+#else
+	inline float4 splat(float f) { return { { f, f, f, f } }; }
+	inline float4 load4(const float* p) { return { { p[0], p[1], p[2], p[3] } }; }
+	inline void store4(float* p, float4 a) { std::copy(a.v, a.v + simd_width, p); }
+
+	template <typename F>
+	float4 lanes4(F f) {
+		float4 r;
+		for (int i = 0; i < simd_width; i++) {
+			r.v[i] = f(i);
+		}
+		return r;
+	}
+	template <typename F>
+	mask4 test4(F f) {
+		mask4 m = { 0 };
+		for (int i = 0; i < simd_width; i++) {
+			m.bits |= f(i) ? 1 << i : 0;
+		}
+		return m;
+	}
+
+	inline float4 operator+(float4 a, float4 b) { return lanes4([&](int i) { return a.v[i] + b.v[i]; }); }
+	inline float4 operator-(float4 a, float4 b) { return lanes4([&](int i) { return a.v[i] - b.v[i]; }); }
+	inline float4 operator*(float4 a, float4 b) { return lanes4([&](int i) { return a.v[i] * b.v[i]; }); }
+	inline float4 operator/(float4 a, float4 b) { return lanes4([&](int i) { return a.v[i] / b.v[i]; }); }
+	// b when either is NaN, as minps and maxps.
+	inline float4 min4(float4 a, float4 b) { return lanes4([&](int i) { return a.v[i] < b.v[i] ? a.v[i] : b.v[i]; }); }
+	inline float4 max4(float4 a, float4 b) { return lanes4([&](int i) { return a.v[i] > b.v[i] ? a.v[i] : b.v[i]; }); }
+	inline float4 abs4(float4 a) { return lanes4([&](int i) { return std::abs(a.v[i]); }); }
+
+	inline mask4 operator<=(float4 a, float4 b) { return test4([&](int i) { return a.v[i] <= b.v[i]; }); }
+	inline mask4 operator>=(float4 a, float4 b) { return test4([&](int i) { return a.v[i] >= b.v[i]; }); }
+	inline mask4 operator&(mask4 a, mask4 b) { return { a.bits & b.bits }; }
+	inline mask4 operator|(mask4 a, mask4 b) { return { a.bits | b.bits }; }
+	inline int movemask(mask4 m) { return m.bits; }
+#endif
+
+	// Rounds d down to a float, clamped to the finite float range.
+	// Bounds use +-max double for infinite shapes, clamping keeps later math free of inf-inf NaNs.
+	inline float float_down(double d) {
+		if (d <= -FLT_MAX) return -FLT_MAX;
+		if (d >= FLT_MAX) return FLT_MAX;
+		float f = static_cast<float>(d);
+		if (f > d) {
+			f = std::nextafter(f, -FLT_MAX);
+		}
+		return f;
+	}
+
+	// Rounds d up to a float, clamped to the finite float range.
+	inline float float_up(double d) {
+		if (d <= -FLT_MAX) return -FLT_MAX;
+		if (d >= FLT_MAX) return FLT_MAX;
+		float f = static_cast<float>(d);
+		if (f < d) {
+			f = std::nextafter(f, FLT_MAX);
+		}
+		return f;
+	}
+
+	// Float inverse direction. Ray uses max double for axis aligned directions.
+	inline float float_inv(double d) {
+		return static_cast<float>(std::clamp<double>(d, -FLT_MAX, FLT_MAX));
+	}
+
+	// Pad for rays from origin coordinate o. Rounding the origin to float, and the distances from it to a box, is off
+	// by a few ulps of |o|, which a small box far from the ray's origin can be smaller than.
+	inline float origin_pad(double o) {
+		return float_up(std::abs(o) * 1e-6);
+	}
+
+	// Float copy of a bounding box, padded outward for the rounding of its own coordinates. Together with the ray's
+	// origin_pad, float slab tests never reject a box the double test accepts.
+	struct FloatBounds {
+		float min[3];
+		float max[3];
+
+		FloatBounds() {
+			for (int i = 0; i < 3; i++) {
+				min[i] = FLT_MAX;
+				max[i] = -FLT_MAX;
+			}
+		}
+
+		FloatBounds(const Bounds& b) {
+			const double inmin[3] = { b.min.x, b.min.y, b.min.z };
+			const double inmax[3] = { b.max.x, b.max.y, b.max.z };
+			for (int i = 0; i < 3; i++) {
+				if (inmin[i] > inmax[i]) {
+					// empty bounds stay inverted.
+					min[i] = FLT_MAX;
+					max[i] = -FLT_MAX;
+					continue;
+				}
+				// float has ~7 digits, pad by a few ulps of the coordinate magnitude and the box size.
+				double pad = (std::abs(inmin[i]) + std::abs(inmax[i]) + (inmax[i] - inmin[i])) * 1e-6;
+				min[i] = float_down(inmin[i] - pad);
+				max[i] = float_up(inmax[i] + pad);
+			}
+		}
+	};
+
+	// Slab test on 4 lanes: lanes are either 4 rays against 1 box, or 1 ray against 4 boxes.
+	// Same test as Group::local_intersect: hit when the largest per axis entry is before the smallest per axis exit.
+	// Boxes are grown by the rays' origin_pad p. Returns lane hit mask, and entry distance per lane in tnear.
+	inline int slab4(float4 ox, float4 oy, float4 oz,
+		float4 ix, float4 iy, float4 iz,
+		float4 px, float4 py, float4 pz,
+		float4 minx, float4 miny, float4 minz,
+		float4 maxx, float4 maxy, float4 maxz,
+		float4& tnear) {
+
+		float4 tx0 = (minx - px - ox) * ix;
+		float4 tx1 = (maxx + px - ox) * ix;
+		float4 ty0 = (miny - py - oy) * iy;
+		float4 ty1 = (maxy + py - oy) * iy;
+		float4 tz0 = (minz - pz - oz) * iz;
+		float4 tz1 = (maxz + pz - oz) * iz;
+
+		float4 tmin = max4(min4(tx0, tx1), max4(min4(ty0, ty1), min4(tz0, tz1)));
+		float4 tmax = min4(max4(tx0, tx1), min4(max4(ty0, ty1), max4(tz0, tz1)));
+
+		tnear = tmin;
+		return movemask(tmin <= tmax);
+	}
+
+	// Bounds of up to simd_width boxes in SoA layout, so one ray is tested against all of them at once.
+	struct BoundsPack {
+		alignas(16) float minx[simd_width] = {};
+		alignas(16) float miny[simd_width] = {};
+		alignas(16) float minz[simd_width] = {};
+		alignas(16) float maxx[simd_width] = {};
+		alignas(16) float maxy[simd_width] = {};
+		alignas(16) float maxz[simd_width] = {};
+		// lanes holding a box.
+		int active = 0;
+
+		void set(int lane, const FloatBounds& b) {
+			minx[lane] = b.min[0];
+			miny[lane] = b.min[1];
+			minz[lane] = b.min[2];
+			maxx[lane] = b.max[0];
+			maxy[lane] = b.max[1];
+			maxz[lane] = b.max[2];
+			active |= 1 << lane;
+		}
+
+		FloatBounds get(int lane) const {
+			FloatBounds b;
+			b.min[0] = minx[lane];
+			b.min[1] = miny[lane];
+			b.min[2] = minz[lane];
+			b.max[0] = maxx[lane];
+			b.max[1] = maxy[lane];
+			b.max[2] = maxz[lane];
+			return b;
+		}
+
+		// Returns mask of active boxes hit by the (broadcast) ray, and their entry distances.
+		int hit_mask(float4 ox, float4 oy, float4 oz, float4 ix, float4 iy, float4 iz, float4 px, float4 py, float4 pz,
+			float* tnear) const {
+			float4 t;
+			int mask = slab4(ox, oy, oz, ix, iy, iz, px, py, pz,
+				load4(minx), load4(miny), load4(minz),
+				load4(maxx), load4(maxy), load4(maxz),
+				t);
+			store4(tnear, t);
+			return mask & active;
+		}
+	};
+
+	// Up to simd_width triangles in SoA float layout, so one ray is tested against all of them at once.
+	struct TrianglePack {
+		alignas(16) float p1x[simd_width] = {};
+		alignas(16) float p1y[simd_width] = {};
+		alignas(16) float p1z[simd_width] = {};
+		alignas(16) float e1x[simd_width] = {};
+		alignas(16) float e1y[simd_width] = {};
+		alignas(16) float e1z[simd_width] = {};
+		alignas(16) float e2x[simd_width] = {};
+		alignas(16) float e2y[simd_width] = {};
+		alignas(16) float e2z[simd_width] = {};
+		// magnitudes (sums of absolute coordinates) bounding the float error: |p1|, |e1| + |e2| and |e1| * |e2|.
+		alignas(16) float p1n[simd_width] = {};
+		alignas(16) float esum[simd_width] = {};
+		alignas(16) float eprod[simd_width] = {};
+		const Triangle* triangle[simd_width] = {};
+		int active = 0;
+
+		void set(int lane, const Triangle* t, const Point3& p1, const Vec3& e1, const Vec3& e2) {
+			p1x[lane] = static_cast<float>(p1.x);
+			p1y[lane] = static_cast<float>(p1.y);
+			p1z[lane] = static_cast<float>(p1.z);
+			e1x[lane] = static_cast<float>(e1.x);
+			e1y[lane] = static_cast<float>(e1.y);
+			e1z[lane] = static_cast<float>(e1.z);
+			e2x[lane] = static_cast<float>(e2.x);
+			e2y[lane] = static_cast<float>(e2.y);
+			e2z[lane] = static_cast<float>(e2.z);
+			double e1n = std::abs(e1.x) + std::abs(e1.y) + std::abs(e1.z);
+			double e2n = std::abs(e2.x) + std::abs(e2.y) + std::abs(e2.z);
+			p1n[lane] = float_up(std::abs(p1.x) + std::abs(p1.y) + std::abs(p1.z));
+			esum[lane] = float_up(e1n + e2n);
+			eprod[lane] = float_up(e1n * e2n);
+			triangle[lane] = t;
+			active |= 1 << lane;
+		}
+
+		// Returns mask of triangles the ray may hit: Triangle::local_intersect's test in float, a filter whose hits must
+		// be confirmed by the double test. It is conservative: every bound on the float error below grows with the
+		// magnitudes involved, so tiny triangles and far origins get wide slack rather than lost hits, and lanes whose
+		// det is too close to the double test's cutoff to tell are passed on.
+		int hit_mask(float4 ox, float4 oy, float4 oz, float4 dx, float4 dy, float4 dz) const {
+			return test(ox, oy, oz, dx, dy, dz,
+				load4(p1x), load4(p1y), load4(p1z), load4(e1x), load4(e1y), load4(e1z), load4(e2x), load4(e2y), load4(e2z),
+				load4(p1n), load4(esum), load4(eprod)) & active;
+		}
+
+		// Same filter, of triangle lane against 4 rays: a packet, lane i of o and d being ray i.
+		int rays_mask(int lane, float4 ox, float4 oy, float4 oz, float4 dx, float4 dy, float4 dz) const {
+			return test(ox, oy, oz, dx, dy, dz,
+				splat(p1x[lane]), splat(p1y[lane]), splat(p1z[lane]),
+				splat(e1x[lane]), splat(e1y[lane]), splat(e1z[lane]),
+				splat(e2x[lane]), splat(e2y[lane]), splat(e2z[lane]),
+				splat(p1n[lane]), splat(esum[lane]), splat(eprod[lane]));
+		}
+
+	private:
+		// The filter on 4 lanes, each a ray and a triangle.
+		static int test(float4 ox, float4 oy, float4 oz, float4 dx, float4 dy, float4 dz,
+			float4 p1x, float4 p1y, float4 p1z, float4 bx, float4 by, float4 bz, float4 ax, float4 ay, float4 az,
+			float4 p1n, float4 esum, float4 eprod) {
+			// relative error of a few dozen float roundings, the L1 magnitudes over estimate the rest.
+			const float4 k = splat(16 * FLT_EPSILON);
+			float4 dn = k * (abs4(dx) + abs4(dy) + abs4(dz));
+
+			// dir_cross_e2, det
+			float4 px = dy * az - dz * ay;
+			float4 py = dz * ax - dx * az;
+			float4 pz = dx * ay - dy * ax;
+			float4 det = bx * px + by * py + bz * pz;
+			float4 absdet = abs4(det);
+			float4 deterr = dn * eprod;
+
+			// the double test drops |det| < RAY_EPSILON, drop only lanes surely below that.
+			mask4 mask = absdet + deterr >= splat(static_cast<float>(RAY_EPSILON));
+			// too close to parallel for float to place the hit.
+			mask4 unsure = absdet <= deterr + deterr;
+			float4 f = splat(1) / det;
+
+			// p1_to_origin, u
+			float4 tx = ox - p1x;
+			float4 ty = oy - p1y;
+			float4 tz = oz - p1z;
+			float4 u = f * (tx * px + ty * py + tz * pz);
+
+			// origin_cross_e1, v
+			float4 qx = ty * bz - tz * by;
+			float4 qy = tz * bx - tx * bz;
+			float4 qz = tx * by - ty * bx;
+			float4 v = f * (dx * qx + dy * qy + dz * qz);
+
+			// barycentric slack: the error of u's and v's numerators, which grows with the distance from p1 (the
+			// origin's own rounding included), and of det, over the smallest det can be. Plus a fixed margin.
+			float4 tn = abs4(tx) + abs4(ty) + abs4(tz);
+			float4 reach = tn + (p1n + p1n);
+			float4 numerr = dn * esum * reach;
+			float4 slack = splat(1.0f / 1024) + splat(2) * (numerr + deterr) / absdet;
+
+			float4 lo = splat(0) - slack;
+			float4 hi = splat(1) + slack;
+			mask4 inside = (u >= lo) & (u <= hi) & (v >= lo) & (u + v <= hi + slack);
+			return movemask(mask & (unsure | inside));
+		}
+	};
+
+} // namespace ray
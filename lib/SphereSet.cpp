@@ -0,0 +1,206 @@
+#include "pch.h"
+#include <stdexcept>
+
+#include "SphereSet.h"
+#include "Intersect.h"
+#include "Bvh.h"
+#include "Stats.h"
+
+using namespace ray;
+
+// Build:
+// 1. Morton code of each center, quantized in the bounds of all centers, radix sorted
+// 2. consecutive runs of 8 sorted spheres become blocks
+// 3. every 4 blocks (then every 4 packs) get a BoundsPack, up to a single root pack
+SphereSet::SphereSet(const std::vector<Entry>& spheres, const Matrix4& t) : Shape(t) {
+	if (spheres.empty()) {
+		throw std::runtime_error("SphereSet needs at least one sphere");
+	}
+
+	Bounds cb;
+	for (const auto& s : spheres) {
+		cb.add(s.center);
+	}
+	Vec3 extent = cb.max - cb.min;
+	Vec3 scale(extent.x > 0 ? 1 / extent.x : 0, extent.y > 0 ? 1 / extent.y : 0, extent.z > 0 ? 1 / extent.z : 0);
+
+	std::vector<MortonPrim> prims(spheres.size());
+	for (size_t i = 0; i < spheres.size(); i++) {
+		Vec3 offset = spheres[i].center - cb.min;
+		prims[i].code = morton_code(offset.x * scale.x, offset.y * scale.y, offset.z * scale.z);
+		prims[i].index = static_cast<uint32_t>(i);
+	}
+	radix_sort(prims);
+
+	_centers.reserve(spheres.size());
+	_radii.reserve(spheres.size());
+	for (const auto& p : prims) {
+		_centers.push_back(spheres[p.index].center);
+		_radii.push_back(spheres[p.index].radius);
+	}
+
+	// Blocks and their bounds. Unused lanes of the last block get an empty sphere far outside everything.
+	size_t nblocks = (_centers.size() + block_size - 1) / block_size;
+	_blocks.resize(nblocks);
+	std::vector<Bounds> bounds(nblocks);
+	for (size_t i = 0; i < nblocks * block_size; i++) {
+		Block& block = _blocks[i / block_size];
+		size_t lane = i % block_size;
+		if (i >= _centers.size()) {
+			block.cx[lane] = block.cy[lane] = block.cz[lane] = FLT_MAX;
+			block.r2[lane] = -1;
+			continue;
+		}
+
+		const Point3& c = _centers[i];
+		double r = _radii[i];
+		block.cx[lane] = static_cast<float>(c.x);
+		block.cy[lane] = static_cast<float>(c.y);
+		block.cz[lane] = static_cast<float>(c.z);
+		block.r2[lane] = float_up(r * r * (1 + 1e-4));
+
+		bounds[i / block_size].add(Bounds(Point3(c.x - r, c.y - r, c.z - r), Point3(c.x + r, c.y + r, c.z + r)));
+	}
+
+	for (const auto& b : bounds) {
+		_bounds.add(b);
+	}
+
+	// Tree levels, bottom up.
+	do {
+		std::vector<BoundsPack> level((bounds.size() + simd_width - 1) / simd_width);
+		std::vector<Bounds> parents(level.size());
+		for (size_t i = 0; i < bounds.size(); i++) {
+			level[i / simd_width].set(i % simd_width, FloatBounds(bounds[i]));
+			parents[i / simd_width].add(bounds[i]);
+		}
+		_levels.push_back(std::move(level));
+		bounds = std::move(parents);
+	} while (bounds.size() > 1);
+}
+
+Vec3 SphereSet::local_normal_at(const Point3& local_point, const Intersection& hit) const {
+	return local_point - _centers[hit.index];
+}
+
+void SphereSet::local_intersect(const Ray& local_ray, IntersectionList& out) const {
+	float4 ox = splat(static_cast<float>(local_ray.origin.x));
+	float4 oy = splat(static_cast<float>(local_ray.origin.y));
+	float4 oz = splat(static_cast<float>(local_ray.origin.z));
+	float4 ix = splat(float_inv(local_ray.invdirection().x));
+	float4 iy = splat(float_inv(local_ray.invdirection().y));
+	float4 iz = splat(float_inv(local_ray.invdirection().z));
+	float4 px = splat(origin_pad(local_ray.origin.x));
+	float4 py = splat(origin_pad(local_ray.origin.y));
+	float4 pz = splat(origin_pad(local_ray.origin.z));
+
+	// (level, pack) still to visit. Each visit pushes at most simd_width, so this bounds the stack for any tree
+	// up to 16 levels (4^16 blocks).
+	// tnear: entry distance of the node's box, checked again when popped as the nearest hit may have moved closer.
+	struct Node {
+		size_t level;
+		size_t pack;
+		float tnear;
+	};
+	Node stack[16 * (simd_width - 1) + 1];
+	size_t top = 0;
+	stack[top++] = { _levels.size() - 1, 0, -FLT_MAX };
+
+	while (top > 0) {
+		Node node = stack[--top];
+		if (out.past(node.tnear)) {
+			continue;
+		}
+		count(&RayStats::nodes_visited);
+		float tnear[simd_width];
+		int mask = _levels[node.level][node.pack].hit_mask(ox, oy, oz, ix, iy, iz, px, py, pz, tnear);
+
+		// children hit, far to near.
+		Node children[simd_width];
+		size_t hits = 0;
+		for (int lane = 0; mask != 0; lane++, mask >>= 1) {
+			if ((mask & 1) == 0 || out.past(tnear[lane])) {
+				continue;
+			}
+			// at level 0 the children are blocks, and pack says which.
+			Node c{ node.level > 0 ? node.level - 1 : 0, node.pack * simd_width + lane, tnear[lane] };
+			size_t i = hits++;
+			while (i > 0 && children[i - 1].tnear < c.tnear) {
+				children[i] = children[i - 1];
+				i--;
+			}
+			children[i] = c;
+		}
+
+		if (node.level == 0) {
+			for (size_t i = hits; i-- > 0;) {
+				if (out.past(children[i].tnear)) {
+					break;
+				}
+				intersect_block(children[i].pack, local_ray, out);
+				if (out.done()) {
+					return;
+				}
+			}
+		}
+		else {
+			// pushed far first, so the nearest is visited next.
+			for (size_t i = 0; i < hits; i++) {
+				stack[top++] = children[i];
+			}
+		}
+	}
+}
+
+void SphereSet::intersect_block(size_t block, const Ray& local_ray, IntersectionList& out) const {
+	const Block& b = _blocks[block];
+	const Vec3& d = local_ray.direction();
+	float4 ox = splat(static_cast<float>(local_ray.origin.x));
+	float4 oy = splat(static_cast<float>(local_ray.origin.y));
+	float4 oz = splat(static_cast<float>(local_ray.origin.z));
+	float4 dx = splat(static_cast<float>(d.x));
+	float4 dy = splat(static_cast<float>(d.y));
+	float4 dz = splat(static_cast<float>(d.z));
+	float4 dd = splat(static_cast<float>(d.dot(d)));
+
+	for (int half = 0; half < block_size; half += simd_width) {
+		// distance from center to the ray line, squared and times d.d: |oc|^2 d.d - (d.oc)^2
+		float4 ocx = ox - load4(b.cx + half);
+		float4 ocy = oy - load4(b.cy + half);
+		float4 ocz = oz - load4(b.cz + half);
+		float4 ococ = ocx * ocx + ocy * ocy + ocz * ocz;
+		float4 doc = dx * ocx + dy * ocy + dz * ocz;
+		float4 dist = ococ * dd - doc * doc;
+
+		// hit when within r, plus slack for the float cancellation above.
+		float4 r2 = load4(b.r2 + half);
+		float4 limit = (r2 + ococ * splat(1e-5f)) * dd;
+		int mask = movemask((dist <= limit) & (r2 >= splat(0)));
+		for (int lane = 0; mask != 0; lane++, mask >>= 1) {
+			if (mask & 1) {
+				intersect_sphere(block * block_size + half + lane, local_ray, out);
+			}
+		}
+	}
+}
+
+void SphereSet::intersect_sphere(size_t i, const Ray& local_ray, IntersectionList& out) const {
+	count(&RayStats::sphere_tests);
+	Vec3 sphere_ray = local_ray.origin - _centers[i];
+	double a = local_ray.direction().dot(local_ray.direction());
+	double b = 2 * local_ray.direction().dot(sphere_ray);
+	double c = sphere_ray.dot(sphere_ray) - _radii[i] * _radii[i];
+	double discriminant = b * b - 4 * a * c;
+	if (discriminant < 0) {
+		return;
+	}
+
+	double mul = 1 / (2 * a);
+	double sqrtdisc = sqrt(discriminant);
+	Intersection t1((-b - sqrtdisc) * mul, this);
+	t1.index = static_cast<uint32_t>(i);
+	out.append(std::move(t1));
+	Intersection t2((-b + sqrtdisc) * mul, this);
+	t2.index = static_cast<uint32_t>(i);
+	out.append(std::move(t2));
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <vector>
+#include "Tuple.h"
+#include "Shape.h"
+#include "Simd.h"
+
+namespace ray {
+
+	// Many spheres sharing one material, eg. particles.
+	// Stores a center and radius per sphere instead of a Sphere with its own matrix, and intersects them 8 at a time.
+	// Spheres are reordered along the Morton curve into blocks of 8, with a 4 wide tree of block bounds on top.
+	class SphereSet : public Shape
+	{
+	public:
+		// spheres per leaf block, tested in two SSE steps.
+		static constexpr int block_size = 8;
+
+		struct Entry {
+			Point3 center;
+			double radius;
+		};
+
+		SphereSet(const std::vector<Entry>& spheres, const Matrix4& t = Matrix4::identity());
+
+		friend std::ostream& operator<<(std::ostream& os, const SphereSet& rhs) {
+			return os << "SphereSet(" << rhs.size() << ", " << rhs.transform << ", " << rhs.material << ")";
+		}
+
+		size_t size() const {
+			return _centers.size();
+		}
+
+		// Sphere i in sorted order, which is also Intersection::index of its hits.
+		const Point3& center(size_t i) const {
+			return _centers[i];
+		}
+		double radius(size_t i) const {
+			return _radii[i];
+		}
+
+		Bounds bounds() const override {
+			return _bounds;
+		}
+
+		Vec3 local_normal_at(const Point3& local_point, const Intersection& hit) const override;
+		void local_intersect(const Ray& local_ray, IntersectionList& out) const override;
+
+	private:
+		// Float copy of a block of spheres in SoA layout, radius squared padded so the float test never drops a hit.
+		struct Block {
+			alignas(16) float cx[block_size];
+			alignas(16) float cy[block_size];
+			alignas(16) float cz[block_size];
+			alignas(16) float r2[block_size];
+		};
+
+		std::vector<Point3> _centers;
+		std::vector<double> _radii;
+		std::vector<Block> _blocks;
+		// _levels[0] pack p holds bounds of blocks p * simd_width + lane, _levels[k] pack p bounds of _levels[k - 1] packs.
+		// The last level is the single root pack.
+		std::vector<std::vector<BoundsPack>> _levels;
+		Bounds _bounds;
+
+		void intersect_block(size_t block, const Ray& local_ray, IntersectionList& out) const;
+		// double test of sphere i, same math as Sphere::local_intersect.
+		void intersect_sphere(size_t i, const Ray& local_ray, IntersectionList& out) const;
+	};
+
+} // namespace ray
@@ -0,0 +1,45 @@
+#include "pch.h"
+
+#include "Stats.h"
+
+using namespace ray;
+
+RayStats& RayStats::operator+=(const RayStats& rhs) {
+	camera_rays += rhs.camera_rays;
+	shadow_rays += rhs.shadow_rays;
+	reflection_rays += rhs.reflection_rays;
+	refraction_rays += rhs.refraction_rays;
+	nodes_visited += rhs.nodes_visited;
+	sphere_tests += rhs.sphere_tests;
+	plane_tests += rhs.plane_tests;
+	cube_tests += rhs.cube_tests;
+	cylinder_tests += rhs.cylinder_tests;
+	cone_tests += rhs.cone_tests;
+	triangle_tests += rhs.triangle_tests;
+	list_heap_allocations += rhs.list_heap_allocations;
+	return *this;
+}
+
+RayStats& RayStats::local() {
+	thread_local RayStats stats;
+	return stats;
+}
+
+RayStats RayStats::take() {
+	RayStats taken = local();
+	local() = RayStats();
+	return taken;
+}
+
+namespace ray {
+	std::ostream& operator<<(std::ostream& os, const RayStats& s) {
+		os << "rays: " << s.rays() << " (camera " << s.camera_rays << ", shadow " << s.shadow_rays
+			<< ", reflection " << s.reflection_rays << ", refraction " << s.refraction_rays << ")\n";
+		os << "nodes visited: " << s.nodes_visited << "\n";
+		os << "primitive tests: " << s.primitive_tests() << " (sphere " << s.sphere_tests << ", plane " << s.plane_tests
+			<< ", cube " << s.cube_tests << ", cylinder " << s.cylinder_tests << ", cone " << s.cone_tests
+			<< ", triangle " << s.triangle_tests << ")\n";
+		os << "intersection list heap allocations: " << s.list_heap_allocations << "\n";
+		return os;
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+
+// Counters of rays traced and intersection work done, to see where render time goes.
+// Only compiled in with RAY_STATS defined (cmake -DRAY_STATS=ON), otherwise counting compiles to nothing.
+
+namespace ray {
+
+#ifdef RAY_STATS
+	constexpr bool stats_enabled = true;
+#else
+	constexpr bool stats_enabled = false;
+#endif
+
+	struct RayStats {
+		uint64_t camera_rays = 0;
+		uint64_t shadow_rays = 0;
+		uint64_t reflection_rays = 0;
+		uint64_t refraction_rays = 0;
+		// Groups whose children were tested, and SphereSet tree packs.
+		uint64_t nodes_visited = 0;
+		// Exact ray / primitive tests. SphereSet spheres count as spheres.
+		uint64_t sphere_tests = 0;
+		uint64_t plane_tests = 0;
+		uint64_t cube_tests = 0;
+		uint64_t cylinder_tests = 0;
+		uint64_t cone_tests = 0;
+		uint64_t triangle_tests = 0;
+		// IntersectionLists that had to allocate: no spare buffer in the pool, or more hits than it held.
+		uint64_t list_heap_allocations = 0;
+
+		uint64_t rays() const {
+			return camera_rays + shadow_rays + reflection_rays + refraction_rays;
+		}
+
+		uint64_t primitive_tests() const {
+			return sphere_tests + plane_tests + cube_tests + cylinder_tests + cone_tests + triangle_tests;
+		}
+
+		RayStats& operator+=(const RayStats& rhs);
+
+		// Counters of the calling thread.
+		static RayStats& local();
+		// Returns the calling thread's counters, and zeroes them.
+		static RayStats take();
+
+		// Multi line summary.
+		friend std::ostream& operator<<(std::ostream& os, const RayStats& s);
+	};
+
+	// Adds n to field of the calling thread's counters. Nothing without RAY_STATS.
+	inline void count(uint64_t RayStats::* field, uint64_t n = 1) {
+		if constexpr (stats_enabled) {
+			RayStats::local().*field += n;
+		}
+	}
+
+} // namespace ray
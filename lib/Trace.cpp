@@ -0,0 +1,155 @@
+#include "pch.h"
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <ios>
+
+#include "Trace.h"
+
+using namespace ray;
+
+namespace {
+	struct Event {
+		const char* name;
+		double begin;
+		double duration;
+	};
+
+	// Events of one row. Only its thread appends, so recording takes no lock.
+	struct Row {
+		int tid;
+		std::string name;
+		std::vector<Event> events;
+		// its thread has exited, the row can be given to a new thread.
+		bool free = false;
+	};
+
+	struct Registry {
+		std::mutex lock;
+		std::vector<std::unique_ptr<Row>> rows;
+		std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+	};
+
+	Registry& registry() {
+		static Registry r;
+		return r;
+	}
+
+	// Hands the row back when its thread exits.
+	struct LocalRow {
+		Row* row = nullptr;
+
+		~LocalRow() {
+			if (row) {
+				std::lock_guard<std::mutex> guard(registry().lock);
+				row->free = true;
+			}
+		}
+	};
+
+	thread_local LocalRow local_row;
+
+	// The calling thread's row: a free one labelled name, else a new one. Call with the registry locked.
+	Row& take_row(Registry& r, const std::string& name) {
+		for (auto& row : r.rows) {
+			if (row->free && row->name == name) {
+				row->free = false;
+				local_row.row = row.get();
+				return *row;
+			}
+		}
+		r.rows.push_back(std::make_unique<Row>());
+		r.rows.back()->tid = static_cast<int>(r.rows.size());
+		r.rows.back()->name = name;
+		local_row.row = r.rows.back().get();
+		return *local_row.row;
+	}
+
+	Row& row() {
+		if (!local_row.row) {
+			Registry& r = registry();
+			std::lock_guard<std::mutex> guard(r.lock);
+			return take_row(r, "");
+		}
+		return *local_row.row;
+	}
+
+	void write_string(std::ostream& os, const std::string& s) {
+		os << '"';
+		for (char c : s) {
+			if (c == '"' || c == '\\') {
+				os << '\\';
+			}
+			os << c;
+		}
+		os << '"';
+	}
+}
+
+void Trace::start() {
+	registry().origin = std::chrono::steady_clock::now();
+	_enabled.store(true);
+}
+
+void Trace::stop() {
+	_enabled.store(false);
+}
+
+double Trace::now() {
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - registry().origin).count();
+}
+
+int Trace::thread_id() {
+	return row().tid;
+}
+
+void Trace::name_thread(const std::string& name) {
+	Registry& r = registry();
+	std::lock_guard<std::mutex> guard(r.lock);
+	if (!local_row.row) {
+		take_row(r, name);
+	}
+	else {
+		local_row.row->name = name;
+	}
+}
+
+void Trace::complete(const char* name, int tid, double begin, double end) {
+	Row& mine = row();
+	if (tid == mine.tid) {
+		mine.events.push_back({ name, begin, end - begin });
+		return;
+	}
+	// on behalf of another thread, which must be done recording.
+	Registry& r = registry();
+	std::lock_guard<std::mutex> guard(r.lock);
+	r.rows[tid - 1]->events.push_back({ name, begin, end - begin });
+}
+
+void Trace::write(std::ostream& os) {
+	Registry& r = registry();
+	std::lock_guard<std::mutex> guard(r.lock);
+	// microseconds to the nanosecond, however long the run.
+	std::ios::fmtflags flags = os.flags(std::ios::fixed);
+	std::streamsize precision = os.precision(3);
+	os << "{\"traceEvents\":[";
+	const char* separator = "\n";
+	for (auto& row : r.rows) {
+		if (!row->name.empty()) {
+			os << separator << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << row->tid << ",\"args\":{\"name\":";
+			write_string(os, row->name);
+			os << "}}";
+			separator = ",\n";
+		}
+		for (const auto& e : row->events) {
+			os << separator << "{\"name\":";
+			write_string(os, e.name);
+			os << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << row->tid << ",\"ts\":" << e.begin << ",\"dur\":" << e.duration << "}";
+			separator = ",\n";
+		}
+		row->events.clear();
+	}
+	os << "\n],\"displayTimeUnit\":\"ms\"}\n";
+	os.flags(flags);
+	os.precision(precision);
+}
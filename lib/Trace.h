@@ -0,0 +1,60 @@
+#pragma once
+#include <atomic>
+#include <ostream>
+#include <string>
+
+// Timeline of scoped events per thread, written in Chrome's trace event format (open in chrome://tracing or
+// ui.perfetto.dev). Off until Trace::start, and while off a TraceScope costs one relaxed atomic load.
+
+namespace ray {
+
+	class Trace {
+	public:
+		// Starts recording, times count from here.
+		static void start();
+		// Stops recording, events recorded so far are kept for write.
+		static void stop();
+
+		static bool enabled() {
+			return _enabled.load(std::memory_order_relaxed);
+		}
+
+		// Microseconds since start.
+		static double now();
+		// Row of the calling thread in the trace.
+		static int thread_id();
+		// Label of the calling thread's row. Named before its first event, a thread continues the row of a finished
+		// thread of the same name, so the render threads of every frame share a row each.
+		static void name_thread(const std::string& name);
+		// Records an event from begin to end (from now()) on row tid. name must outlive the trace, a string literal.
+		static void complete(const char* name, int tid, double begin, double end);
+
+		// Writes every recorded event as trace event JSON, and clears them. Call with no traced work running.
+		static void write(std::ostream& os);
+
+	private:
+		inline static std::atomic<bool> _enabled = false;
+	};
+
+	// Records an event on the calling thread from construction to destruction, if tracing is on at construction.
+	class TraceScope {
+	public:
+		explicit TraceScope(const char* name) :
+			_name(Trace::enabled() ? name : nullptr),
+			_begin(_name ? Trace::now() : 0) {}
+
+		~TraceScope() {
+			if (_name) {
+				Trace::complete(_name, Trace::thread_id(), _begin, Trace::now());
+			}
+		}
+
+		TraceScope(const TraceScope&) = delete;
+		TraceScope& operator=(const TraceScope&) = delete;
+
+	private:
+		const char* _name;
+		double _begin;
+	};
+
+} // namespace ray
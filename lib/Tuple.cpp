@@ -3,6 +3,6 @@
 
 namespace ray {
 	bool IsEqual(double left, double right) {
-		return abs(left - right) < RAY_EPSILON;
+		return std::abs(left - right) < RAY_EPSILON;
 	}
 } // namespace ray
@@ -2,6 +2,8 @@
 #include <cassert>
 #include <ostream>
 #include <array>
+#include <cmath>
+#include <limits>
 
 namespace ray {
 
@@ -171,6 +173,23 @@ public:
 		return (max.x - min.x) * (max.y - min.y) * (max.z - min.z);
 	}
 
+	// False for unbounded shapes (eg. planes use +-max double) and empty bounds.
+	bool is_finite() const {
+		return std::isfinite(max.x - min.x) && std::isfinite(max.y - min.y) && std::isfinite(max.z - min.z) &&
+			min.x <= max.x && min.y <= max.y && min.z <= max.z;
+	}
+
+	// Surface area, ie. how likely a random ray is to hit the box. 0 for empty bounds.
+	double surface_area() const {
+		if (min.x > max.x || min.y > max.y || min.z > max.z) {
+			return 0;
+		}
+		double dx = max.x - min.x;
+		double dy = max.y - min.y;
+		double dz = max.z - min.z;
+		return 2 * (dx * dy + dy * dz + dz * dx);
+	}
+
 	Point3 center() const {
 		return Point3((max.x + min.x) / 2, (max.y + min.y) / 2, (max.z - min.z) / 2);
 	}
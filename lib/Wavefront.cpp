@@ -4,6 +4,7 @@
 #include <regex>
 
 #include "Wavefront.h"
+#include "Trace.h"
 
 using namespace ray;
 
@@ -121,6 +122,7 @@ bool Wavefront::parseFace(const std::string& line) {
 
 
 void Wavefront::parse(std::istream& input) {
+	TraceScope trace("Wavefront::parse");
 	std::regex reCommand(R"REGEX(^\s*([a-z]+)\s+)REGEX");
 	std::regex reCommandGroup(R"REGEX(^\s*g\s+([a-zA-Z]+))REGEX");
 
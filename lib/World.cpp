@@ -1,5 +1,6 @@
 #include "pch.h"
 #include <memory_resource>
+#include <cstring>
 
 #include "World.h"
 
@@ -24,49 +25,167 @@ std::vector<std::unique_ptr<Shape>> World::make_default_shapes()
 	return vec;
 }
 
-void World::intersect(const Ray& r, IntersectionList& list) const {
-	// bugbug: add some sort of spatial structure here, so we don't need to visit O(n) shapes.
+// Moves the leaves under NoopGroups in shapes into out.
+static void flatten(std::vector<std::unique_ptr<Shape>>&& shapes, std::vector<std::unique_ptr<Shape>>& out) {
+	for (auto& s : shapes) {
+		NoopGroup* g = dynamic_cast<NoopGroup*>(s.get());
+		if (g != nullptr) {
+			flatten(g->extract_shapes(), out);
+			continue;
+		}
+		s->parent = nullptr;
+		out.push_back(std::move(s));
+	}
+}
+
+void World::update_transform(Shape* shape, const Matrix4& transform) {
+	shape->transform = transform;
+	update(shape);
+}
+
+void World::update(Shape* shape) {
+	// Refit up the parent chain, stop once bounds and rays stop changing.
+	// Remember the highest NoopGroup that got too loose.
+	NoopGroup* loosest = nullptr;
+	for (Group* g = static_cast<Group*>(shape->parent); g != nullptr; g = static_cast<Group*>(g->parent)) {
+		NoopGroup* noop = dynamic_cast<NoopGroup*>(g);
+		if (noop != nullptr && noop->built_area < 0) {
+			noop->built_area = noop->bounds().surface_area();
+		}
+
+		if (!g->refit()) {
+			break;
+		}
+
+		if (noop != nullptr && noop->bounds().surface_area() > noop->built_area * _settings.rebuild_ratio) {
+			loosest = noop;
+		}
+	}
+
+	if (loosest == nullptr) {
+		return;
+	}
+
+	// Rebuild in place, our parent keeps pointing at the same group.
+	std::vector<std::unique_ptr<Shape>> leaves;
+	flatten(loosest->extract_shapes(), leaves);
+	for (auto& s : NoopGroup::build(std::move(leaves), _settings.build)) {
+		loosest->add(std::move(s));
+	}
+	loosest->refit();
+	loosest->built_area = loosest->bounds().surface_area();
+
+	Group* g = static_cast<Group*>(loosest->parent);
+	while (g != nullptr && g->refit()) {
+		g = static_cast<Group*>(g->parent);
+	}
+}
+
+void World::collect(const Ray& r, IntersectionList& list) const {
+	for (const auto& s : _unbounded) {
+		s->intersect(r, list);
+		if (list.done()) {
+			return;
+		}
+	}
 	for (const auto& s : _shapes) {
 		s->intersect(r, list);
+		if (list.done()) {
+			return;
+		}
 	}
+}
+
+void World::collect(const RayPacket& packet, IntersectionList* lists) const {
+	for (const auto& s : _unbounded) {
+		s->intersect_packet(packet, packet.active, lists);
+	}
+	for (const auto& s : _shapes) {
+		s->intersect_packet(packet, packet.active, lists);
+	}
+}
+
+void World::intersect(const Ray& r, IntersectionList& list) const {
+	collect(r, list);
 	list.sort();
 }
 
-Color World::color_at(const Ray& ray, int remaining) const {
-	IntersectionList list;
-	intersect(ray, list);
+void World::intersect(const RayPacket& packet, IntersectionList* lists) const {
+	collect(packet, lists);
+	for (int i = 0; i < RayPacket::width; i++) {
+		lists[i].sort();
+	}
+}
+
+Color World::color_at(const Ray& ray, int remaining, const MediumStack& media, RayKind kind) const {
+	if (kind == CameraRay) {
+		count(&RayStats::camera_rays);
+	}
+	IntersectionList list(kind);
+	list.keep_closest();
+	collect(ray, list);
 	const Intersection* hit = list.hit();
 	if (hit == nullptr) {
 		return Color::black();
 	}
-	IntersectionInfo info = list.info(ray, hit);
+	IntersectionInfo info = list.info(ray, hit, media);
 	return shade(info, remaining);
 }
 
+std::array<Color, RayPacket::width> World::color_at(const RayPacket& packet, int remaining) const {
+	std::array<Color, RayPacket::width> colors;
+	colors.fill(Color::black());
+	std::array<IntersectionList, RayPacket::width> lists;
+	for (auto& list : lists) {
+		list.keep_closest();
+	}
+	count(&RayStats::camera_rays, packet.size());
+	collect(packet, lists.data());
+
+	for (int i = 0; i < RayPacket::width; i++) {
+		if ((packet.active & (1 << i)) == 0) {
+			continue;
+		}
+
+		const Intersection* hit = lists[i].hit();
+		if (hit == nullptr) {
+			continue;
+		}
+		IntersectionInfo info = lists[i].info(packet.rays[i], hit, MediumStack());
+		colors[i] = shade(info, remaining);
+	}
+
+	return colors;
+}
+
 bool World::is_shadowed(const Point3& point) const {
-	Vec3 v = _light.position - point;
+	return light_transmittance(point) < IntersectionList::min_transmittance;
+}
+
+double World::light_transmittance(const Point3& point) const {
+	return light_transmittance(_lights[0], point);
+}
+
+double World::light_transmittance(const PointLight& light, const Point3& point) const {
+	Vec3 v = light.position - point;
 	double distance = v.magnitude();
 	Vec3 direction = v.norm();
 	// aim from point to light
 	Ray ray(point, direction);
 
-	IntersectionList list;
-	intersect(ray, list);
-
-	const Intersection* hit = list.hit_ignoretransparent();
-	//const Intersection* hit = list.hit();
-
-	// if you hit something and its closer than the light, you're in the shadows.
-	if (hit != nullptr && hit->t < distance) {
-		return true;
-	}
-	return false;
+	// every surface between us and the light lets through its transparency worth, stops at the first opaque one.
+	IntersectionList list = IntersectionList::shadow(distance);
+	count(&RayStats::shadow_rays);
+	collect(ray, list);
+	return list.transmittance();
 }
 
 Color World::shade(const IntersectionInfo& info, int remaining) const {
-	const Material& material = info.object->material;
-	bool in_shadow = is_shadowed(info.over_point);
-	Color surface = material.lighting(_light, *info.object, info.over_point, info.eye, info.normal, in_shadow);
+	const Material& material = *info.material;
+	// patterns live in the mesh, move instance hits there first.
+	Point3 mesh_point = info.instance != nullptr ? info.instance->world_to_object(info.over_point) : info.over_point;
+	Color base = material.pattern->pattern_at_shape(*info.object, mesh_point);
+	Color surface = lighting(material, base, info);
 	Color reflected = reflected_color(info, remaining);
 	Color refracted = refracted_color(info, remaining);
 
@@ -78,21 +197,120 @@ Color World::shade(const IntersectionInfo& info, int remaining) const {
 	return surface + reflected + refracted;
 }
 
+// Random numbers in [0, 1) seeded by a point (splitmix64), so sampled renders repeat exactly on any number of threads.
+class PointRandom {
+public:
+	PointRandom(const Point3& p) {
+		const double coords[3] = { p.x, p.y, p.z };
+		for (double c : coords) {
+			uint64_t bits;
+			std::memcpy(&bits, &c, sizeof(bits));
+			_state = (_state ^ bits) * 0xbf58476d1ce4e5b9ull;
+		}
+	}
+
+	double next() {
+		uint64_t z = (_state += 0x9e3779b97f4a7c15ull);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		z = z ^ (z >> 31);
+		return (z >> 11) * (1.0 / (1ull << 53));
+	}
+
+private:
+	uint64_t _state = 0;
+};
+
+// 1. every light's unshadowed contribution is estimated from the brightest channel, distance falloff and angle.
+// Lights behind the surface, out of range or below light_cutoff add only their ambient, no shadow ray.
+// 2. with more lights left than light_samples, light_samples picks are drawn with probability proportional
+// to the estimate. A light picked n times is scaled by n / (samples * probability), unbiased over many pixels.
+Color World::lighting(const Material& material, const Color& base, const IntersectionInfo& info) const {
+	thread_local std::vector<double> weight;
+	weight.assign(_lights.size(), 0.0);
+
+	double total = 0;
+	size_t candidates = 0;
+	for (size_t i = 0; i < _lights.size(); i++) {
+		const PointLight& light = _lights[i];
+		Vec3 v = light.position - info.over_point;
+		double distance = v.magnitude();
+		double dotlight = v.dot(info.normal) / distance;
+		if (dotlight <= 0) {
+			continue;
+		}
+		// specular doesn't depend on the angle to the light, only that it's in front.
+		double estimate = light.power() * light.falloff(distance) * (material.diffuse * dotlight + material.specular);
+		if (estimate < _settings.light_cutoff) {
+			continue;
+		}
+		weight[i] = estimate;
+		total += estimate;
+		candidates++;
+	}
+
+	int samples = _settings.light_samples;
+	if (samples > 0 && candidates > static_cast<size_t>(samples)) {
+		// picks per light, then each picked light's scale.
+		thread_local std::vector<int> picks;
+		picks.assign(_lights.size(), 0);
+		PointRandom random(info.over_point);
+		for (int s = 0; s < samples; s++) {
+			double target = random.next() * total;
+			size_t i = 0;
+			// lands on a candidate, rounding can't run past the last one.
+			size_t last = 0;
+			for (; i < _lights.size(); i++) {
+				if (weight[i] == 0) {
+					continue;
+				}
+				last = i;
+				target -= weight[i];
+				if (target < 0) {
+					break;
+				}
+			}
+			picks[i < _lights.size() ? i : last]++;
+		}
+		for (size_t i = 0; i < _lights.size(); i++) {
+			weight[i] = picks[i] == 0 ? 0 : picks[i] * total / (samples * weight[i]);
+		}
+	}
+	else {
+		for (double& w : weight) {
+			w = w > 0 ? 1 : 0;
+		}
+	}
+
+	Color sum = Color::black();
+	for (size_t i = 0; i < _lights.size(); i++) {
+		PointLight light = _lights[i];
+		double visible = weight[i] > 0 ? weight[i] * light_transmittance(light, info.over_point) : 0;
+		if (light.range != std::numeric_limits<double>::infinity()) {
+			light.intensity = light.intensity * light.falloff((light.position - info.over_point).magnitude());
+		}
+		sum = sum + material.lighting(light, base, info.over_point, info.eye, info.normal, visible);
+	}
+	return sum;
+}
+
 Color World::reflected_color(const IntersectionInfo& info, int remaining) const {
 
 	if (remaining <= 0) {
 		return Color::black();
 	}
 
-	double reflective = info.object->material.reflective;
+	double reflective = info.material->reflective;
 
 	// fully absorbtive -> no reflection color
 	if (IsEqual(reflective, 0)) {
 		return Color::black();
 	}
 
+	// reflected rays stay on our side of the surface.
 	Ray reflect_ray(info.over_point, info.reflect);
-	Color c = color_at(reflect_ray, remaining - 1);
+	count(&RayStats::reflection_rays);
+	Color c = color_at(reflect_ray, remaining - 1, info.media, SecondaryRay);
 	return c * reflective;
 }
 
@@ -104,7 +322,7 @@ Color World::refracted_color(const IntersectionInfo& info, int remaining) const
 	}
 
 	// no transparency -> no refraction color
-	double transparency = info.object->material.transparency;
+	double transparency = info.material->transparency;
 	if (IsEqual(transparency, 0)) {
 		return Color::black();
 	}
@@ -121,6 +339,9 @@ Color World::refracted_color(const IntersectionInfo& info, int remaining) const
 	double cos_t = sqrt(1 - sin2_t);
 	Vec3 direction = info.normal * (n_ratio * cos_i - cos_t) - info.eye * n_ratio;
 	Ray refract(info.under_point, direction);
+	MediumStack past = info.media;
+	past.cross(info.object, info.instance, info.index, info.material->refractive_index);
 
-	return color_at(refract, remaining - 1) * transparency;
+	count(&RayStats::refraction_rays);
+	return color_at(refract, remaining - 1, past, SecondaryRay) * transparency;
 }
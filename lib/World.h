@@ -1,18 +1,32 @@
 #pragma once
+#include <stdexcept>
 
 #include "Shape.h"
 #include "Intersect.h"
 #include "Color.h"
+#include "RayPacket.h"
+#include "Trace.h"
 
 namespace ray {
 	class World
 	{
 	public:
 		// specify all the things, nothing added.
-		World(const PointLight& light, std::vector<std::unique_ptr<Shape>>&& shapes) :
-			_light(light),
-			_shapes(std::move(shapes)) {
-			_shapes = NoopGroup::spatialize(std::move(_shapes));
+		World(const PointLight& light, std::vector<std::unique_ptr<Shape>>&& shapes, const RenderSettings& settings = RenderSettings()) :
+			World(std::vector<PointLight>{ light }, std::move(shapes), settings) {}
+
+		// Several lights, each adds its own lighting (ambient included, as in the book).
+		World(const std::vector<PointLight>& lights, std::vector<std::unique_ptr<Shape>>&& shapes, const RenderSettings& settings = RenderSettings()) :
+			_lights(lights),
+			_shapes(std::move(shapes)),
+			_settings(settings) {
+			TraceScope trace("World");
+			if (_lights.empty()) {
+				throw std::runtime_error("World needs at least one light");
+			}
+			// Unbounded shapes would make every bounds around them infinite, keep them out of the hierarchy.
+			_unbounded = NoopGroup::take_unbounded(_shapes);
+			_shapes = NoopGroup::build(std::move(_shapes), _settings.build);
 		}
 
 		// default: get default light + 2 stock shapes
@@ -23,26 +37,67 @@ namespace ray {
 
 		static std::vector<std::unique_ptr<Shape>> make_default_shapes();
 
+		// Hierarchy over shapes with finite bounds.
 		const std::vector<std::unique_ptr<Shape>>& shapes() const {
 			return _shapes;
 		}
 
-		const PointLight& light() {
-			return _light;
+		// Shapes without finite bounds (eg. planes), tested by every ray.
+		const std::vector<std::unique_ptr<Shape>>& unbounded() const {
+			return _unbounded;
+		}
+
+		// The first light.
+		const PointLight& light() const {
+			return _lights[0];
+		}
+
+		const std::vector<PointLight>& lights() const {
+			return _lights;
 		}
 
+		const RenderSettings& settings() const {
+			return _settings;
+		}
+
+		// Moves shape, which can be anywhere in the scene, to transform. Refits the bounds above it, so the cost is its depth.
+		// Subtrees that grow too loose (see RenderSettings::rebuild_ratio) are rebuilt.
+		// Shapes inside instanced meshes are shared, move the Instance instead.
+		void update_transform(Shape* shape, const Matrix4& transform);
+		// Call after changing shape in place (a Cylinder's or Cone's minimum, maximum or closed, the visibility flags), groups
+		// keep copies of those. Refits like update_transform.
+		void update(Shape* shape);
+
 		// populates, and sorts, list with all intersection with r.
 		void intersect(const Ray& r, IntersectionList& list) const;
+		// populates, and sorts, lists[i] with all intersections with packet.rays[i].
+		void intersect(const RayPacket& packet, IntersectionList* lists) const;
 
 		// todo: replace recursion with iteration.
-		Color color_at(const Ray& ray, int remaining = 5) const;
+		// media: surfaces the ray starts inside of, camera rays start outside everything.
+		// kind: CameraRay, or SecondaryRay for reflected and refracted rays, picks which shapes the ray sees.
+		Color color_at(const Ray& ray, int remaining = 5, const MediumStack& media = MediumStack(), RayKind kind = CameraRay) const;
+		// Packet version of color_at, traversal is shared and shading is per ray.
+		std::array<Color, RayPacket::width> color_at(const RayPacket& packet, int remaining = 5) const;
+		// True when (next to) no light from the first light reaches point.
 		bool is_shadowed(const Point3& point) const;
+		// Fraction of the first light reaching point, the product of the transparency of every surface in between.
+		double light_transmittance(const Point3& point) const;
+		double light_transmittance(const PointLight& light, const Point3& point) const;
 		Color shade(const IntersectionInfo& info, int remaining = 5) const;
+		// Sum of every light's lighting at info, see RenderSettings::light_samples and light_cutoff.
+		Color lighting(const Material& material, const Color& base, const IntersectionInfo& info) const;
 		Color reflected_color(const IntersectionInfo& info, int remaining) const;
 		Color refracted_color(const IntersectionInfo& info, int remaining) const;
 
 	private:
+		std::vector<PointLight> _lights;
 		std::vector<std::unique_ptr<Shape>> _shapes;
-		PointLight _light;
+		std::vector<std::unique_ptr<Shape>> _unbounded;
+
+		// intersect without the sort, for callers that only want the nearest hit.
+		void collect(const Ray& r, IntersectionList& list) const;
+		void collect(const RayPacket& packet, IntersectionList* lists) const;
+		RenderSettings _settings;
 	};
 } // namespace ray
@@ -39,6 +39,10 @@ WARRANTY OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
 #include <string.h>
 #include "ply.h"
 
+#ifndef _WIN32
+#define _strdup strdup
+#endif
+
 char *type_names[] = {
 "invalid",
 "char", "short", "int",
@@ -2505,7 +2509,7 @@ Entry:
   fname - file name from which memory was requested
 ******************************************************************************/
 
-static char *my_alloc(int size, int lnum, char *fname)
+char *my_alloc(int size, int lnum, char *fname)
 {
   char *ptr;
 
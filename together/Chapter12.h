@@ -18,7 +18,8 @@ class Chapter12
 {
 
 public:
-	void run() {
+	// Scene objects and light, built with settings.
+	World build(const RenderSettings& settings = RenderSettings()) {
 		std::vector<std::unique_ptr<Shape>> vec;
 
 		{
@@ -91,14 +92,23 @@ public:
 
 		PointLight light(Point3(-9, 9, -9), Color(1, 1, 1));
 
-		World world(light, std::move(vec));
+		return World(light, std::move(vec), settings);
+	}
 
-		Camera camera(2000, 1000, pi / 3);
+	// Camera placement.
+	Matrix4 view() const {
 		Point3 from(2, 2, -8);
 		// side view of cube: Point3 from(-5, 2, 0);
 		Point3 to(0, 0, 0);
 		Vec3 up(0, 1, 0);
-		camera.transform = Matrix4::view(from, to, up);
+		return Matrix4::view(from, to, up);
+	}
+
+	void run() {
+		World world = build();
+
+		Camera camera(2000, 1000, pi / 3);
+		camera.transform = view();
 
 		Canvas canvas = camera.render(world);
 
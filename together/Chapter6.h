@@ -36,7 +36,7 @@ public:
 					const ray::Intersection* i = ray::Intersection::hit(intersections);
 					ray::Point3 point = r.position(i->t);
 					ray::Vec3 normal = sphere.normal_at(point);
-					ray::Color c = sphere.material.lighting(light, sphere, point, -r.direction, normal, false);
+					ray::Color c = sphere.material.lighting(light, sphere, point, -r.direction, normal, 1.0);
 					pixels[x][y] = c;
 				}
 			}
@@ -20,7 +20,8 @@ class BallsInRoom
 public:
 
 
-	void run() {
+	// Scene objects and light, built with settings.
+	World build(const RenderSettings& settings = RenderSettings()) {
 		std::vector<std::unique_ptr<Shape>> vec;
 
         auto floor = std::make_unique<Plane>();
@@ -111,13 +112,22 @@ public:
 
 		PointLight light(Point3(-10, 10, -10), Color(1, 1, 1));
 
-		World world(light, std::move(vec));
+		return World(light, std::move(vec), settings);
+	}
 
-		Camera camera(4000, 2000, pi / 3);
+	// Camera placement.
+	Matrix4 view() const {
 		Point3 from(0, 1.5, -5);
 		Point3 to(0, 1, 0);
 		Vec3 up(0, 1, 0);
-		camera.transform = Matrix4::view(from, to, up);
+		return Matrix4::view(from, to, up);
+	}
+
+	void run() {
+		World world = build();
+
+		Camera camera(4000, 2000, pi / 3);
+		camera.transform = view();
 
 		Canvas canvas = camera.render(world);
 
@@ -19,14 +19,18 @@ class Dragon
 {
 
 public:
+	// Directory holding the model files, with a trailing separator.
+	std::string models = "../models/";
 
-	void run() {
+	// Scene objects and light, built with settings.
+	World build(const RenderSettings& settings = RenderSettings()) {
 		std::vector<std::unique_ptr<Shape>> vec;
 
 		{
-			PlyLoader ply("..\\models\\spider.ply");
+			PlyLoader ply(models + "spider.ply");
 
-			auto g = ply.get_mega_group();
+			// ~9k faces, built like the rest of the scene.
+			auto g = ply.get_mega_group(settings.build);
 			Bounds bounds = g->bounds();
 			std::cout << bounds << std::endl;
 			Point3 c = bounds.center();
@@ -75,13 +79,22 @@ public:
 
 		PointLight light(Point3(-10, 10, -10), Color(1, 1, 1));
 
-		World world(light, std::move(vec));
+		return World(light, std::move(vec), settings);
+	}
 
-		Camera camera(4000, 2000, pi / 3);
+	// Camera placement.
+	Matrix4 view() const {
 		Point3 from(0, 5, -10);
 		Point3 to(0, 0, 0);
 		Vec3 up(0, 1, 0);
-		camera.transform = Matrix4::view(from, to, up);
+		return Matrix4::view(from, to, up);
+	}
+
+	void run() {
+		World world = build();
+
+		Camera camera(4000, 2000, pi / 3);
+		camera.transform = view();
 
 		Canvas canvas = camera.render(world);
 
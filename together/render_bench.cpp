@@ -0,0 +1,388 @@
+// Headless end to end benchmark: renders standard scenes and prints build time, render time, rays/sec and
+// peak memory as JSON on stdout, with the quality of the built hierarchy (BvhReport). Everything the scenes and
+// camera print goes to stderr instead.
+// Built with RAY_STATS, each scene also reports all rays/sec and the counters of its fastest render.
+//
+// render_bench [--scenes chapter11,dragon,...|all] [--width 400] [--height 200] [--threads 0]
+//              [--build bucket|lbvh|sah] [--repeat 1] [--models ../models/] [--heatmap time|nodes|tests]
+//              [--trace out.json] [--scaling 0] [--count 10000] [--depth 4] [--seed 1] [--glass 0.1] [--mirror 0.1] [--huge 0]
+//
+// --heatmap also writes <scene>_heat.ppm per scene, the per pixel cost (Camera::render_heatmap).
+// --trace out.json writes a Chrome trace of the whole run: loading, building and every render thread.
+// --scaling N also renders each scene at 1, 2, 4, ... and N threads (0 for one per hardware thread), with the
+// speedup over one thread, the parallel efficiency (speedup per thread) and each thread's busy and idle seconds.
+// Past hardware_threads / 2 the extra threads are usually hyperthreads.
+//
+// The generated scenes stress_spheres, stress_soup, stress_grid and stress_nested (stress.h) are only rendered when
+// named in --scenes, with --count shapes, --depth group levels (nested only), --seed, the --glass and --mirror
+// fractions, and --huge cylinders across the scene. One scene per run gives its own peak memory, e.g. to plot build
+// time, memory and render time against --count and --threads.
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <thread>
+#include <algorithm>
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#include <io.h>
+#define dup _dup
+#define dup2 _dup2
+#define close _close
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#include "scenes.h"
+#include "Trace.h"
+#include "BvhReport.h"
+
+struct Options {
+	std::vector<std::string> scenes;
+	int width = 400;
+	int height = 200;
+	unsigned threads = 0;
+	BuildMode build = BuildMode::Bucket;
+	int repeat = 1;
+	std::string models = "../models/";
+	bool heatmap = false;
+	Heat heat = Heat::Time;
+	std::string trace;
+	// most threads of the scaling runs, -1 for none.
+	int scaling = -1;
+	StressScene stress;
+};
+
+// While alive, whatever the scenes, loaders and camera print to stdout (printf or std::cout) goes to stderr instead.
+class StdoutToStderr {
+public:
+	StdoutToStderr() {
+		std::cout.flush();
+		fflush(stdout);
+		_saved = dup(1);
+		dup2(2, 1);
+	}
+
+	~StdoutToStderr() {
+		std::cout.flush();
+		fflush(stdout);
+		dup2(_saved, 1);
+		close(_saved);
+	}
+
+private:
+	int _saved;
+};
+
+// Process peak resident memory so far, in KiB.
+static long peak_memory_kb() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+	return static_cast<long>(counters.PeakWorkingSetSize / 1024);
+#else
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+#endif
+}
+
+static const char* build_name(BuildMode mode) {
+	switch (mode) {
+	case BuildMode::Lbvh:
+		return "lbvh";
+	case BuildMode::Sah:
+		return "sah";
+	case BuildMode::Bucket:
+	default:
+		return "bucket";
+	}
+}
+
+// 1, 2, 4, ... up to and including most.
+static std::vector<unsigned> scaling_threads(unsigned most) {
+	std::vector<unsigned> counts;
+	for (unsigned n = 1; n < most; n *= 2) {
+		counts.push_back(n);
+	}
+	counts.push_back(most);
+	return counts;
+}
+
+// Best of repeat renders of world, in seconds. stats and times: the camera's of that render.
+static double best_render(Camera& camera, const World& world, int repeat, RayStats& stats, std::vector<WorkerTime>& times) {
+	double best = 0;
+	for (int r = 0; r < repeat; r++) {
+		auto start = std::chrono::steady_clock::now();
+		camera.render(world);
+		std::chrono::duration<double> render_time = std::chrono::steady_clock::now() - start;
+		if (r == 0 || render_time.count() < best) {
+			best = render_time.count();
+			stats = camera.stats;
+			times = camera.worker_times;
+		}
+	}
+	return best;
+}
+
+static bool parse(int argc, char** argv, Options& options) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (i + 1 >= argc) {
+			std::cerr << "missing value for " << arg << std::endl;
+			return false;
+		}
+		std::string value = argv[++i];
+		if (arg == "--scenes") {
+			std::stringstream list(value);
+			std::string name;
+			while (std::getline(list, name, ',')) {
+				if (name != "all") {
+					options.scenes.push_back(name);
+				}
+			}
+		}
+		else if (arg == "--width") {
+			options.width = std::atoi(value.c_str());
+		}
+		else if (arg == "--height") {
+			options.height = std::atoi(value.c_str());
+		}
+		else if (arg == "--threads") {
+			options.threads = static_cast<unsigned>(std::atoi(value.c_str()));
+		}
+		else if (arg == "--repeat") {
+			options.repeat = std::max(1, std::atoi(value.c_str()));
+		}
+		else if (arg == "--models") {
+			options.models = value;
+		}
+		else if (arg == "--trace") {
+			options.trace = value;
+		}
+		else if (arg == "--scaling") {
+			options.scaling = std::max(0, std::atoi(value.c_str()));
+		}
+		else if (arg == "--count") {
+			options.stress.count = static_cast<size_t>(std::atoll(value.c_str()));
+		}
+		else if (arg == "--depth") {
+			options.stress.depth = std::max(1, std::atoi(value.c_str()));
+		}
+		else if (arg == "--seed") {
+			options.stress.seed = static_cast<uint32_t>(std::atoll(value.c_str()));
+		}
+		else if (arg == "--glass") {
+			options.stress.glass = std::atof(value.c_str());
+		}
+		else if (arg == "--mirror") {
+			options.stress.mirror = std::atof(value.c_str());
+		}
+		else if (arg == "--huge") {
+			options.stress.huge = static_cast<size_t>(std::atoll(value.c_str()));
+		}
+		else if (arg == "--heatmap") {
+			options.heatmap = true;
+			if (value == "time") {
+				options.heat = Heat::Time;
+			}
+			else if (value == "nodes") {
+				options.heat = Heat::Nodes;
+			}
+			else if (value == "tests") {
+				options.heat = Heat::Tests;
+			}
+			else {
+				std::cerr << "unknown heatmap " << value << std::endl;
+				return false;
+			}
+		}
+		else if (arg == "--build") {
+			if (value == "bucket") {
+				options.build = BuildMode::Bucket;
+			}
+			else if (value == "lbvh") {
+				options.build = BuildMode::Lbvh;
+			}
+			else if (value == "sah") {
+				options.build = BuildMode::Sah;
+			}
+			else {
+				std::cerr << "unknown build " << value << std::endl;
+				return false;
+			}
+		}
+		else {
+			std::cerr << "unknown option " << arg << std::endl;
+			return false;
+		}
+	}
+	if (options.heatmap && options.heat != Heat::Time && !stats_enabled) {
+		std::cerr << "node and test heatmaps need a RAY_STATS build" << std::endl;
+		return false;
+	}
+	return options.width > 0 && options.height > 0;
+}
+
+int main(int argc, char** argv) {
+	Options options;
+	if (!parse(argc, argv, options)) {
+		return 2;
+	}
+
+	std::vector<Scene> scenes = all_scenes();
+	bool stressed = false;
+	if (!options.scenes.empty()) {
+		std::vector<Scene> named = scenes;
+		for (auto& s : stress_scenes(options.stress)) {
+			named.push_back(std::move(s));
+		}
+		std::vector<Scene> picked;
+		for (const auto& name : options.scenes) {
+			auto found = std::find_if(named.begin(), named.end(), [&](const Scene& s) { return s.name == name; });
+			stressed |= name.rfind("stress_", 0) == 0;
+			if (found == named.end()) {
+				std::cerr << "unknown scene " << name << std::endl;
+				return 2;
+			}
+			picked.push_back(*found);
+		}
+		scenes = picked;
+	}
+
+	if (!options.trace.empty()) {
+		Trace::start();
+		Trace::name_thread("main");
+	}
+
+	std::stringstream json;
+	json << "{\n";
+	json << "  \"width\": " << options.width << ",\n";
+	json << "  \"height\": " << options.height << ",\n";
+	json << "  \"threads\": " << (options.threads != 0 ? options.threads : std::thread::hardware_concurrency()) << ",\n";
+	json << "  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n";
+	json << "  \"build\": \"" << build_name(options.build) << "\",\n";
+	if (stressed) {
+		json << "  \"stress\": {";
+		json << " \"count\": " << options.stress.count;
+		json << ", \"depth\": " << options.stress.depth;
+		json << ", \"seed\": " << options.stress.seed;
+		json << ", \"glass\": " << options.stress.glass;
+		json << ", \"mirror\": " << options.stress.mirror;
+		json << ", \"huge\": " << options.stress.huge << " },\n";
+	}
+	json << "  \"scenes\": [";
+
+	{
+		StdoutToStderr quiet;
+		for (size_t i = 0; i < scenes.size(); i++) {
+			const Scene& s = scenes[i];
+			Camera camera(options.width, options.height, pi / 3);
+			camera.threads = options.threads;
+			camera.verbose = false;
+
+			// scenes place things with rand(), seed it so every run builds the same scene.
+			srand(1);
+			auto start = std::chrono::steady_clock::now();
+			RenderSettings settings;
+			settings.build = options.build;
+			World world = [&] {
+				TraceScope trace("scene build");
+				return s.build(settings, options.models, camera);
+			}();
+			std::chrono::duration<double> build_time = std::chrono::steady_clock::now() - start;
+
+			RayStats stats;
+			std::vector<WorkerTime> times;
+			double render_seconds = best_render(camera, world, options.repeat, stats, times);
+
+			std::stringstream scaling;
+			if (options.scaling >= 0) {
+				unsigned most = options.scaling != 0 ? options.scaling : std::max(1u, std::thread::hardware_concurrency());
+				double one = 0;
+				for (unsigned n : scaling_threads(most)) {
+					camera.threads = n;
+					RayStats ignored;
+					double seconds = best_render(camera, world, options.repeat, ignored, times);
+					if (n == 1) {
+						one = seconds;
+					}
+					double speedup = one / seconds;
+					scaling << (n == 1 ? "\n" : ",\n");
+					scaling << "        { \"threads\": " << n << ", \"render_seconds\": " << seconds;
+					scaling << ", \"speedup\": " << speedup << ", \"efficiency\": " << speedup / n;
+					scaling << ", \"busy_seconds\": [";
+					for (size_t t = 0; t < times.size(); t++) {
+						scaling << (t == 0 ? "" : ", ") << times[t].busy;
+					}
+					scaling << "], \"idle_seconds\": [";
+					for (size_t t = 0; t < times.size(); t++) {
+						scaling << (t == 0 ? "" : ", ") << times[t].idle;
+					}
+					scaling << "] }";
+				}
+				camera.threads = options.threads;
+			}
+
+			if (options.heatmap) {
+				Canvas heat = camera.render_heatmap(world, options.heat);
+				std::ofstream out(s.name + "_heat.ppm");
+				heat.write_ppm(out);
+			}
+
+			double primary_rays = static_cast<double>(options.width) * options.height;
+			json << (i == 0 ? "\n" : ",\n");
+			json << "    {\n";
+			json << "      \"name\": \"" << s.name << "\",\n";
+			json << "      \"build_seconds\": " << build_time.count() << ",\n";
+			BvhReport bvh(world);
+			json << "      \"bvh\": {";
+			json << " \"nodes\": " << bvh.nodes;
+			json << ", \"primitives\": " << bvh.primitives;
+			json << ", \"max_depth\": " << bvh.max_depth;
+			json << ", \"top_level\": " << bvh.top_level;
+			json << ", \"huge\": " << bvh.huge;
+			json << ", \"unbounded\": " << bvh.unbounded;
+			json << ", \"sibling_overlap\": " << bvh.sibling_overlap;
+			json << ", \"expected_node_visits\": " << bvh.expected_node_visits;
+			json << ", \"expected_primitive_tests\": " << bvh.expected_primitive_tests;
+			json << ", \"sah_cost\": " << bvh.sah_cost << " },\n";
+			json << "      \"render_seconds\": " << render_seconds << ",\n";
+			json << "      \"primary_rays_per_second\": " << primary_rays / render_seconds << ",\n";
+			if (stats_enabled) {
+				json << "      \"rays_per_second\": " << stats.rays() / render_seconds << ",\n";
+				json << "      \"stats\": {";
+				json << " \"camera_rays\": " << stats.camera_rays;
+				json << ", \"shadow_rays\": " << stats.shadow_rays;
+				json << ", \"reflection_rays\": " << stats.reflection_rays;
+				json << ", \"refraction_rays\": " << stats.refraction_rays;
+				json << ", \"nodes_visited\": " << stats.nodes_visited;
+				json << ", \"primitive_tests\": " << stats.primitive_tests();
+				json << ", \"list_heap_allocations\": " << stats.list_heap_allocations << " },\n";
+			}
+			if (options.scaling >= 0) {
+				json << "      \"scaling\": [" << scaling.str() << "\n      ],\n";
+			}
+			// process wide, so it includes the scenes before this one.
+			json << "      \"peak_memory_kb\": " << peak_memory_kb() << "\n";
+			json << "    }";
+		}
+	}
+	json << "\n  ]\n}\n";
+
+	std::cout << json.str();
+
+	if (!options.trace.empty()) {
+		Trace::stop();
+		std::ofstream out(options.trace);
+		Trace::write(out);
+	}
+	return 0;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "Chapter11.h"
+#include "Chapter12.h"
+#include "Chapter13.h"
+#include "Chapter14.h"
+#include "lots_of_spheres.h"
+#include "balls_in_room.h"
+#include "dragon.h"
+#include "spiders.h"
+#include "stress.h"
+
+// The standard scenes, by name. Shared by render_bench and the golden image tests.
+// The generated stress scenes are apart, their size depends on options and they have no golden image.
+
+struct Scene {
+	std::string name;
+	// builds the world with settings, and sets the camera's transform. models: directory of the scanned models.
+	std::function<World(const RenderSettings&, const std::string& models, Camera&)> build;
+};
+
+template <class T>
+inline Scene scene(const std::string& name) {
+	return { name, [](const RenderSettings& settings, const std::string&, Camera& camera) {
+		T t;
+		camera.transform = t.view();
+		return t.build(settings);
+	} };
+}
+
+inline std::vector<Scene> all_scenes() {
+	return {
+		scene<Chapter11>("chapter11"),
+		scene<Chapter12>("chapter12"),
+		scene<Chapter13>("chapter13"),
+		scene<Chapter14>("chapter14"),
+		scene<LotsSpheres>("lots_of_spheres"),
+		scene<BallsInRoom>("balls_in_room"),
+		{ "dragon", [](const RenderSettings& settings, const std::string& models, Camera& camera) {
+			Dragon d;
+			d.models = models;
+			camera.transform = d.view();
+			return d.build(settings);
+		} },
+		{ "spiders", [](const RenderSettings& settings, const std::string& models, Camera& camera) {
+			Spiders s;
+			s.models = models;
+			camera.transform = s.view();
+			return s.build(settings);
+		} },
+	};
+}
+
+// One scene per StressScene::Kind, built with options' count, depth, seed and mix.
+inline std::vector<Scene> stress_scenes(const StressScene& options) {
+	auto stress = [&](const std::string& name, StressScene::Kind kind) {
+		StressScene s = options;
+		s.kind = kind;
+		return Scene{ name, [s](const RenderSettings& settings, const std::string&, Camera& camera) {
+			camera.transform = s.view();
+			return s.build(settings);
+		} };
+	};
+	return {
+		stress("stress_spheres", StressScene::Kind::Spheres),
+		stress("stress_soup", StressScene::Kind::TriangleSoup),
+		stress("stress_grid", StressScene::Kind::TriangleGrid),
+		stress("stress_nested", StressScene::Kind::Nested),
+	};
+}
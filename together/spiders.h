@@ -0,0 +1,88 @@
+#pragma once
+#include <fstream>
+#include <memory>
+#include <string>
+#include "Shape.h"
+#include "World.h"
+#include "Camera.h"
+#include "PlyLoader.h"
+
+using namespace ray;
+
+// One spider mesh placed five times with Instance: the mesh and its hierarchy are built once and shared.
+class Spiders
+{
+public:
+	// Directory holding the model files, with a trailing separator.
+	std::string models = "../models/";
+
+	// Scene objects and light, built with settings.
+	World build(const RenderSettings& settings = RenderSettings()) const {
+		std::vector<std::unique_ptr<Shape>> vec;
+
+		// ~9k faces, z up in the file. Stood up, centered on the origin and scaled to about 2 across, feet on y = 0.
+		std::shared_ptr<Group> spider;
+		{
+			PlyLoader ply(models + "spider.ply");
+			spider = ply.get_mega_group(settings.build);
+			Bounds bounds = spider->bounds();
+			Point3 c = bounds.center();
+			double scale = 2 / (bounds.max.x - bounds.min.x);
+			spider->transform = Matrix4::scale(scale, scale, scale) * Matrix4::rotateX(-pi / 2) *
+				Matrix4::translate(-c.x, -c.y, -bounds.min.z);
+			Material m;
+			m.pattern = std::make_unique<Solid>(Color::beige());
+			spider->update_material(m);
+		}
+
+		for (int i = -2; i <= 2; i++) {
+			auto s = std::make_unique<Instance>(spider);
+			s->transform = Matrix4::translate(i * 2.2, 0, i * i * 0.5) * Matrix4::rotateY(i * pi / 5);
+			// the middle one keeps the mesh's own material.
+			if (i == -2 || i == 2) {
+				Material m = Material::glass();
+				m.pattern = std::make_unique<Solid>(Color::aquamarine());
+				m.diffuse = 0.2;
+				s->update_material(m);
+			}
+			else if (i != 0) {
+				Material m;
+				m.pattern = std::make_unique<Solid>(i < 0 ? Color::chocolate() : Color::powderblue());
+				m.reflective = 0.3;
+				s->update_material(m);
+			}
+			vec.push_back(std::move(s));
+		}
+
+		{
+			auto floor = std::make_unique<Plane>();
+			floor->material.pattern = std::make_unique<Checker>(Color::white(), Color::lightgrey());
+			floor->material.pattern->transform = Matrix4::scale(2, 2, 2);
+			vec.push_back(std::move(floor));
+		}
+
+		PointLight light(Point3(-6, 10, -10), Color(1, 1, 1));
+
+		return World(light, std::move(vec), settings);
+	}
+
+	// Camera placement.
+	Matrix4 view() const {
+		Point3 from(0, 3, -8);
+		Point3 to(0, 0.5, 1);
+		Vec3 up(0, 1, 0);
+		return Matrix4::view(from, to, up);
+	}
+
+	void run() {
+		World world = build();
+
+		Camera camera(1000, 500, pi / 3);
+		camera.transform = view();
+
+		Canvas canvas = camera.render(world);
+
+		std::ofstream ostrm("spiders.ppm", std::ios::binary);
+		canvas.write_ppm(ostrm);
+	}
+};
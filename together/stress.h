@@ -0,0 +1,179 @@
+#pragma once
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <string>
+#include "Shape.h"
+#include "World.h"
+#include "Camera.h"
+
+using namespace ray;
+
+// Generated scenes of any size, to measure how build time, memory and render time scale.
+// Same parameters and seed, same scene. Shapes fill a cube that grows with count, so density stays the same.
+class StressScene
+{
+public:
+	enum class Kind {
+		// count spheres at random.
+		Spheres,
+		// count small triangles at random positions and orientations.
+		TriangleSoup,
+		// a height field of count triangles.
+		TriangleGrid,
+		// count spheres at the bottom of groups nested depth deep, every group with its own transform.
+		Nested,
+	};
+
+	Kind kind = Kind::Spheres;
+	size_t count = 10000;
+	// group levels above the spheres, Nested only.
+	int depth = 4;
+	// fraction of shapes that are glass, and that are mirrors. The rest are diffuse, in random colors.
+	double glass = 0.1;
+	double mirror = 0.1;
+	// long thin cylinders at random angles across the whole scene, whose bounds overlap everything.
+	size_t huge = 0;
+	uint32_t seed = 1;
+
+	// Half the side of the cube the shapes are in.
+	double extent() const {
+		return 2 * std::cbrt(static_cast<double>(std::max<size_t>(count, 1)));
+	}
+
+	// Scene objects and light, built with settings.
+	World build(const RenderSettings& settings = RenderSettings()) const {
+		std::mt19937 rng(seed);
+		std::vector<std::unique_ptr<Shape>> vec;
+		double e = extent();
+
+		switch (kind) {
+		case Kind::Spheres:
+			for (size_t i = 0; i < count; i++) {
+				auto s = std::make_unique<Sphere>();
+				s->transform = Matrix4::translate(uniform(rng, -e, e), uniform(rng, -e, e), uniform(rng, -e, e)) *
+					Matrix4::scale(uniform(rng, 0.3, 1), uniform(rng, 0.3, 1), uniform(rng, 0.3, 1));
+				s->material = material(rng);
+				vec.push_back(std::move(s));
+			}
+			break;
+		case Kind::TriangleSoup:
+			for (size_t i = 0; i < count; i++) {
+				Point3 c(uniform(rng, -e, e), uniform(rng, -e, e), uniform(rng, -e, e));
+				auto corner = [&] { return c + Vec3(uniform(rng, -1, 1), uniform(rng, -1, 1), uniform(rng, -1, 1)); };
+				auto t = std::make_unique<Triangle>(corner(), corner(), corner());
+				t->material = material(rng);
+				vec.push_back(std::move(t));
+			}
+			break;
+		case Kind::TriangleGrid: {
+			// two triangles per cell.
+			size_t cells = std::max<size_t>(1, static_cast<size_t>(std::sqrt(count / 2.0)));
+			double step = 2 * e / cells;
+			auto height = [&](size_t x, size_t z) { return e / 4 * std::sin(x * 0.7) * std::cos(z * 0.5); };
+			auto at = [&](size_t x, size_t z) { return Point3(-e + x * step, height(x, z), -e + z * step); };
+			for (size_t x = 0; x < cells; x++) {
+				for (size_t z = 0; z < cells; z++) {
+					auto a = std::make_unique<Triangle>(at(x, z), at(x + 1, z), at(x + 1, z + 1));
+					auto b = std::make_unique<Triangle>(at(x, z), at(x + 1, z + 1), at(x, z + 1));
+					a->material = material(rng);
+					b->material = material(rng);
+					vec.push_back(std::move(a));
+					vec.push_back(std::move(b));
+				}
+			}
+			break;
+		}
+		case Kind::Nested: {
+			size_t branching = std::max<size_t>(2, static_cast<size_t>(std::ceil(std::pow(static_cast<double>(count), 1.0 / std::max(depth, 1)))));
+			size_t left = count;
+			auto root = nest(rng, std::max(depth, 1), branching, left);
+			root->transform = Matrix4::scale(e, e, e);
+			vec.push_back(std::move(root));
+			break;
+		}
+		}
+
+		for (size_t i = 0; i < huge; i++) {
+			auto c = std::make_unique<Cylinder>();
+			c->minimum = -1;
+			c->maximum = 1;
+			c->closed = true;
+			c->transform = Matrix4::rotateY(uniform(rng, 0, 2 * pi)) * Matrix4::rotateZ(uniform(rng, 0, 2 * pi)) *
+				Matrix4::scale(0.2, e, 0.2);
+			c->material = material(rng);
+			vec.push_back(std::move(c));
+		}
+
+		auto floor = std::make_unique<Plane>();
+		floor->transform = Matrix4::translate(0, -e - 1, 0);
+		floor->material.pattern = std::make_unique<Checker>(Color::white(), Color::lightgrey());
+		vec.push_back(std::move(floor));
+
+		PointLight light(Point3(-2 * e, 3 * e, -2 * e), Color(1, 1, 1));
+		return World(light, std::move(vec), settings);
+	}
+
+	// Camera placement, far enough back to see the whole cube.
+	Matrix4 view() const {
+		double e = extent();
+		Point3 from(0, e * 0.6, -e * 2.6);
+		Point3 to(0, 0, 0);
+		Vec3 up(0, 1, 0);
+		return Matrix4::view(from, to, up);
+	}
+
+	void run() {
+		World world = build();
+
+		Camera camera(1000, 500, pi / 3);
+		camera.transform = view();
+
+		Canvas canvas = camera.render(world);
+
+		std::ofstream ostrm("stress.ppm", std::ios::binary);
+		canvas.write_ppm(ostrm);
+	}
+
+private:
+	static double uniform(std::mt19937& rng, double from, double to) {
+		return std::uniform_real_distribution<double>(from, to)(rng);
+	}
+
+	Material material(std::mt19937& rng) const {
+		double pick = uniform(rng, 0, 1);
+		if (pick < glass) {
+			return Material::glass();
+		}
+		if (pick < glass + mirror) {
+			return Material::mirror();
+		}
+		Material m;
+		m.pattern = std::make_unique<Solid>(Color(uniform(rng, 0.1, 1), uniform(rng, 0.1, 1), uniform(rng, 0.1, 1)));
+		return m;
+	}
+
+	// Group over the unit cube with up to branching children, levels deep, taking spheres from left.
+	std::unique_ptr<Group> nest(std::mt19937& rng, int levels, size_t branching, size_t& left) const {
+		auto g = std::make_unique<Group>();
+		// children are scaled to a little more than their share of the cube, so siblings overlap some.
+		double scale = std::min(1.0, 1.2 / std::cbrt(static_cast<double>(branching)));
+		for (size_t i = 0; i < branching && left > 0; i++) {
+			Matrix4 place = Matrix4::translate(uniform(rng, scale - 1, 1 - scale), uniform(rng, scale - 1, 1 - scale),
+				uniform(rng, scale - 1, 1 - scale)) * Matrix4::rotateY(uniform(rng, 0, 2 * pi)) * Matrix4::scale(scale, scale, scale);
+			if (levels > 1) {
+				auto child = nest(rng, levels - 1, branching, left);
+				child->transform = place;
+				g->add(std::move(child));
+			}
+			else {
+				auto s = std::make_unique<Sphere>();
+				s->transform = place;
+				s->material = material(rng);
+				g->add(std::move(s));
+				left--;
+			}
+		}
+		return g;
+	}
+};
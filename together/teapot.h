@@ -63,13 +63,18 @@ public:
 			//vec.push_back(std::move(g));
 		}
 
-		for (int x = -10; x < 11; x += 5)
+		// one cow mesh, placed 5 times.
+		std::shared_ptr<Group> cow;
 		{
 			std::ifstream file("cow.obj");
 			Wavefront w(file);
+			cow = w.get_mega_group();
+		}
 
-			auto g = w.get_mega_group();
-			g->transform = Matrix4::translate(x, -g->bounds().min.y, 10) * Matrix4::rotateY(pi / 2);
+		for (int x = -10; x < 11; x += 5)
+		{
+			auto g = std::make_unique<Instance>(cow);
+			g->transform = Matrix4::translate(x, -cow->bounds().min.y, 10) * Matrix4::rotateY(pi / 2);
 			Material m;
 			m.pattern = std::make_unique<Solid>(Color::chocolate());
 
@@ -80,7 +85,7 @@ public:
 			}
 
 			g->update_material(m);
-			//vec.push_back(std::move(g));
+			vec.push_back(std::move(g));
 		}
 
 		{